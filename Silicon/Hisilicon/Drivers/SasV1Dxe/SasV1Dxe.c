@@ -189,7 +189,18 @@
 #define SGE_LIMIT 0x10000
 #define upper_32_bits(n) ((UINT32)(((n) >> 16) >> 16))
 #define lower_32_bits(n) ((UINT32)(n))
-#define MAX_TARGET_ID 4
+// Link-up polling in Start, in milliseconds
+#define PHY_UP_TIMEOUT 100
+#define PHY_UP_SETTLE  10
+
+// Completion poll period for non-blocking requests, in 100ns units (1ms)
+#define ASYNC_POLL_INTERVAL 10000
+// Request timeout when the packet sets none, in 100ns units (30s)
+#define CMD_TIMEOUT 300000000
+// Discovery INQUIRY timeout, in 100ns units (1s)
+#define INQUIRY_TIMEOUT 10000000
+
+#define BOUNCE_CNT 21
 
 // Generic HW DMA host memory structures
 struct hisi_sas_cmd_hdr {
@@ -261,8 +272,49 @@ struct hisi_sas_sts {
 UINT32 status[260];
 };
 
+// Uncached buffer the hardware transfers data to and from
+struct hisi_sas_bounce {
+    VOID *buf;
+    UINT32 size;
+    BOOLEAN used;
+};
+
 struct hisi_sas_slot {
     BOOLEAN used;
+    BOOLEAN done;
+    BOOLEAN sense;
+    BOOLEAN read;
+    BOOLEAN abandoned;
+    EFI_STATUS status;
+    EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET *Packet;
+    EFI_EVENT Event;
+    VOID *Buffer;
+    UINTN BufferSize;
+    struct hisi_sas_bounce *bounce;
+    // Allocated when the pool has no free buffer large enough
+    struct hisi_sas_bounce own;
+    UINT64 start;
+    UINT64 timeout_ns;
+    UINT8 opcode;
+};
+
+struct hisi_sas_op_stats {
+    UINT64 cmds;
+    UINT64 errors;
+    UINT64 total_ns;
+    UINT64 max_ns;
+};
+
+struct hisi_sas_stats {
+    UINT64 cmds;
+    UINT64 errors;
+    UINT64 total_ns;
+    UINT64 max_ns;
+    // Same counters per SCSI opcode, a READ and a TEST UNIT READY differ a lot
+    struct hisi_sas_op_stats op[256];
+    UINT64 allocated;
+    UINT64 bounced;
+    UINT64 copy_ns;
 };
 
 struct hisi_hba {
@@ -280,6 +332,21 @@ struct hisi_hba {
     int port_id;
     UINT32 LatestTargetId;
     UINT64 LatestLun;
+    UINT32 pending_async;
+    BOOLEAN discovered;
+    BOOLEAN present[MAX_ITCT_ENTRIES];
+    struct hisi_sas_bounce bounce[BOUNCE_CNT];
+    struct hisi_sas_stats stats;
+};
+
+// Bounce pool layout, smallest first so requests take the tightest fit
+STATIC CONST struct {
+    UINT32 size;
+    UINT32 count;
+} bounce_cfg[] = {
+    { SIZE_4KB,  16 },
+    { SIZE_64KB, 4 },
+    { SIZE_1MB,  1 },
 };
 
 #pragma pack (1)
@@ -302,9 +369,45 @@ typedef struct {
 #define SAS_DEVICE_SIGNATURE SIGNATURE_32 ('S','A','S','0')
 #define SAS_FROM_PASS_THRU(a) CR (a, SAS_V1_INFO, ExtScsiPassThru, SAS_DEVICE_SIGNATURE)
 
+STATIC UINT64 elapsed_ns (UINT64 start)
+{
+  return GetTimeInNanoSecond (GetPerformanceCounter () - start);
+}
+
+STATIC struct hisi_sas_bounce *bounce_get (struct hisi_hba *hba, UINTN size)
+{
+  int i;
+
+  for (i = 0; i < BOUNCE_CNT; i++) {
+    if (hba->bounce[i].buf && !hba->bounce[i].used && size <= hba->bounce[i].size) {
+      hba->bounce[i].used = TRUE;
+      return &hba->bounce[i];
+    }
+  }
+  return NULL;
+}
+
+STATIC VOID bounce_put (struct hisi_sas_slot *slot)
+{
+  if (slot->bounce == &slot->own) {
+    DmaFreeBuffer (EFI_SIZE_TO_PAGES (slot->own.size), slot->own.buf);
+    slot->own.buf = NULL;
+  }
+  slot->bounce->used = FALSE;
+  slot->bounce = NULL;
+}
+
+//
+// Deliver a command to a free slot without waiting for it to complete.
+// The slot index doubles as the IPTT, so the completion queue entry leads
+// straight back to the slot. Must be called at TPL_NOTIFY.
+//
 STATIC EFI_STATUS prepare_cmd (
   struct hisi_hba *hba,
-  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET    *Packet
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET    *Packet,
+  EFI_EVENT                                     Event,
+  UINT32                                        dev_id,
+  UINT32                                        *SlotIdx
   )
 {
   struct hisi_sas_slot *slot;
@@ -318,11 +421,11 @@ STATIC EFI_STATUS prepare_cmd (
   int queue = hba->queue;
   UINT32 r, w = 0, slot_idx = 0;
   UINT32 base = hba->base;
-  UINT8 *p;
   EFI_PHYSICAL_ADDRESS  BufferAddress;
   EFI_STATUS            Status = EFI_SUCCESS;
-  VOID                  *BufferMap = NULL;
-  DMA_MAP_OPERATION DmaOperation = MapOperationBusMasterCommonBuffer;
+  BOOLEAN               read = FALSE;
+  struct hisi_sas_bounce *bounce;
+  UINT64 copy_start;
 
   while (1) {
     w = READ_REG32(base, DLVRY_Q_0_WR_PTR + (queue * 0x14));
@@ -351,8 +454,20 @@ STATIC EFI_STATUS prepare_cmd (
     ZeroMem (SensePtr, sizeof (EFI_SCSI_SENSE_DATA));
 
   slot->used = TRUE;
+  slot->done = FALSE;
+  slot->sense = FALSE;
+  slot->status = EFI_SUCCESS;
+  slot->Packet = Packet;
+  slot->Event = Event;
+  slot->bounce = NULL;
+  slot->start = GetPerformanceCounter ();
+  slot->timeout_ns = MultU64x32 (Packet->Timeout ? Packet->Timeout : CMD_TIMEOUT, 100);
+  slot->opcode = ((UINT8 *)Packet->Cdb)[0];
   hba->queue = (queue + 1) % QUEUE_CNT;
 
+  Packet->HostAdapterStatus = EFI_EXT_SCSI_STATUS_HOST_ADAPTER_OK;
+  Packet->TargetStatus = EFI_EXT_SCSI_STATUS_TARGET_GOOD;
+
   // Only consider ssp
   hdr->dw0 = (1 << CMD_HDR_RESP_REPORT_OFF) |
        (0x2 << CMD_HDR_TLR_CTRL_OFF) |
@@ -360,7 +475,7 @@ STATIC EFI_STATUS prepare_cmd (
        (1 << CMD_HDR_MODE_OFF) |
        (1 << CMD_HDR_CMD_OFF);
   hdr->dw1 = 1 << CMD_HDR_VERIFY_DTL_OFF;
-  hdr->dw1 |= 0 << CMD_HDR_DEVICE_ID_OFF;
+  hdr->dw1 |= dev_id << CMD_HDR_DEVICE_ID_OFF;
   hdr->dw2 = 0x83000d;
   hdr->transfer_tags = slot_idx << CMD_HDR_IPTT_OFF;
 
@@ -369,13 +484,12 @@ STATIC EFI_STATUS prepare_cmd (
     BufferSize = Packet->InTransferLength;
     if (Buffer) {
       hdr->dw1 |= 1 << CMD_HDR_SSP_FRAME_TYPE_OFF;
-      DmaOperation = MapOperationBusMasterWrite;
+      read = TRUE;
     }
   } else if (Packet->DataDirection == EFI_EXT_SCSI_DATA_DIRECTION_WRITE) {
     Buffer = Packet->OutDataBuffer;
     BufferSize = Packet->OutTransferLength;
     if (Buffer) {
-      DmaOperation = MapOperationBusMasterRead;
       hdr->dw1 |= 2 << CMD_HDR_SSP_FRAME_TYPE_OFF;
     }
   } else {
@@ -392,10 +506,35 @@ STATIC EFI_STATUS prepare_cmd (
     struct hisi_sas_sge *sg;
     UINT32 remain, len, pos = 0, i = 0;
 
-    Status = DmaMap (DmaOperation, Buffer, &BufferSize, &BufferAddress, &BufferMap);
-    if (EFI_ERROR (Status)) {
-      return Status;
+    copy_start = GetPerformanceCounter ();
+
+    // The hardware only ever transfers to and from driver owned memory.
+    // There is no way to abort a command, so after a timeout the hardware
+    // may still write data long after the caller's buffer has been reused.
+    bounce = bounce_get (hba, BufferSize);
+    if (bounce == NULL) {
+      bounce = &slot->own;
+      Status = DmaAllocateBuffer (EfiBootServicesData, EFI_SIZE_TO_PAGES (BufferSize), &bounce->buf);
+      if (EFI_ERROR (Status)) {
+        slot->used = FALSE;
+        return Status;
+      }
+      bounce->size = BufferSize;
+      bounce->used = TRUE;
+      hba->stats.allocated++;
+    }
+
+    if (!read) {
+      CopyMem (bounce->buf, Buffer, BufferSize);
     }
+    BufferAddress = (EFI_PHYSICAL_ADDRESS)(UINTN)bounce->buf;
+    hba->stats.bounced++;
+    hba->stats.copy_ns += elapsed_ns (copy_start);
+
+    slot->bounce = bounce;
+    slot->Buffer = Buffer;
+    slot->BufferSize = BufferSize;
+    slot->read = read;
     remain = len = BufferSize;
 
     while (remain) {
@@ -422,54 +561,360 @@ STATIC EFI_STATUS prepare_cmd (
   // Start dma
   WRITE_REG32(base, DLVRY_Q_0_WR_PTR + queue * 0x14, ++w % QUEUE_SLOTS);
 
-  // Wait for dma complete
-  while (slot->used) {
-    if (READ_REG32(base, OQ_INT_SRC) & BIT(queue)) {
-      struct hisi_sas_complete_hdr *complete_hdr;
-      UINT32 data, rd;
-      rd = READ_REG32(base, COMPL_Q_0_RD_PTR + (0x14 * queue));
+  *SlotIdx = slot_idx;
+  return EFI_SUCCESS;
+}
+
+STATIC VOID slot_complete (
+  struct hisi_hba *hba,
+  UINT32 slot_idx,
+  UINT32 data
+  )
+{
+  struct hisi_sas_slot *slot = &hba->slots[slot_idx];
+  struct hisi_sas_sts *sts;
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET *Packet;
+  EFI_SCSI_SENSE_DATA *SensePtr;
+  UINT8 *p;
+  UINT64 copy_start, ns;
+  struct hisi_sas_op_stats *op;
+
+  if (!slot->used || slot->done) {
+    DEBUG ((EFI_D_ERROR, "sas stale completion iptt=0x%x\n", slot_idx));
+    return;
+  }
+
+  Packet = slot->Packet;
+  sts = &hba->status_buf[slot_idx / QUEUE_SLOTS][slot_idx % QUEUE_SLOTS];
+
+  // Check whether dma transfer error
+  if ((data & CMPLT_HDR_ERR_RCRD_XFRD_MSK) &&
+    !(data & CMPLT_HDR_RSPNS_XFRD_MSK)) {
+    DEBUG ((EFI_D_VERBOSE, "sas retry data=0x%x\n", data));
+    DEBUG ((EFI_D_VERBOSE, "sts[0]=0x%x\n", sts->status[0]));
+    DEBUG ((EFI_D_VERBOSE, "sts[1]=0x%x\n", sts->status[1]));
+    DEBUG ((EFI_D_VERBOSE, "sts[2]=0x%x\n", sts->status[2]));
+    slot->status = EFI_NOT_READY;
+    hba->stats.errors++;
+    hba->stats.op[slot->opcode].errors++;
+  }
+
+  // The hardware is done with the slot, its bounce buffer can be reused
+  copy_start = GetPerformanceCounter ();
+  if (slot->bounce) {
+    if (slot->read) {
+      CopyMem (slot->Buffer, slot->bounce->buf, slot->BufferSize);
+    }
+    bounce_put (slot);
+  }
+  hba->stats.copy_ns += elapsed_ns (copy_start);
+
+  if (slot->abandoned) {
+    // The caller timed out and has gone, only recycle the slot
+    slot->abandoned = FALSE;
+    slot->used = FALSE;
+    return;
+  }
+
+  ns = elapsed_ns (slot->start);
+  hba->stats.cmds++;
+  hba->stats.total_ns += ns;
+  if (ns > hba->stats.max_ns) {
+    hba->stats.max_ns = ns;
+  }
+  op = &hba->stats.op[slot->opcode];
+  op->cmds++;
+  op->total_ns += ns;
+  if (ns > op->max_ns) {
+    op->max_ns = ns;
+  }
 
+  p = (UINT8 *)&sts->status[0];
+  if (p[SENSE_DATA_PRES]) {
+    // Disk not ready normal return for ScsiDiskTestUnitReady do next try
+    SensePtr = Packet->SenseData;
+    if (SensePtr) {
+      SensePtr->Sense_Key = EFI_SCSI_SK_NOT_READY;
+      SensePtr->Addnl_Sense_Code = EFI_SCSI_ASC_NOT_READY;
+      SensePtr->Addnl_Sense_Code_Qualifier = EFI_SCSI_ASCQ_IN_PROGRESS;
+    }
+    slot->sense = TRUE;
+  }
+
+  if (slot->Event == NULL) {
+    // Blocking caller recycles the slot once it has seen the result
+    slot->done = TRUE;
+    return;
+  }
+
+  // Non-blocking request, the status is reported through the packet
+  if (EFI_ERROR (slot->status)) {
+    Packet->HostAdapterStatus = EFI_EXT_SCSI_STATUS_HOST_ADAPTER_OTHER;
+  }
+  if (slot->sense) {
+    Packet->TargetStatus = EFI_EXT_SCSI_STATUS_TARGET_CHECK_CONDITION;
+  }
+  slot->used = FALSE;
+  hba->pending_async--;
+  gBS->SignalEvent (slot->Event);
+}
+
+//
+// Reap every completion queue that has raised its interrupt source. Entries
+// may complete out of order, each one is matched to its slot by IPTT.
+// Must be called at TPL_NOTIFY.
+//
+STATIC VOID cq_poll (struct hisi_hba *hba)
+{
+  struct hisi_sas_complete_hdr *complete_hdr;
+  UINT32 base = hba->base;
+  UINT32 src, rd, wr, data, iptt;
+  int queue;
+
+  src = READ_REG32(base, OQ_INT_SRC);
+  for (queue = 0; src != 0 && queue < QUEUE_CNT; queue++) {
+    if (!(src & BIT(queue)))
+      continue;
+    src &= ~BIT(queue);
+
+    // Clear int before sampling write point, so later entries raise it again
+    WRITE_REG32(base, OQ_INT_SRC, BIT(queue));
+    wr = READ_REG32(base, COMPL_Q_0_WR_PTR + (0x14 * queue));
+    rd = READ_REG32(base, COMPL_Q_0_RD_PTR + (0x14 * queue));
+
+    while (rd != wr) {
       complete_hdr = &hba->complete_hdr[queue][rd];
       data = complete_hdr->data;
-
-      // Check whether dma transfer error
-      if ((data & CMPLT_HDR_ERR_RCRD_XFRD_MSK) &&
-        !(data & CMPLT_HDR_RSPNS_XFRD_MSK)) {
-        DEBUG ((EFI_D_VERBOSE, "sas retry data=0x%x\n", data));
-        DEBUG ((EFI_D_VERBOSE, "sts[0]=0x%x\n", sts->status[0]));
-        DEBUG ((EFI_D_VERBOSE, "sts[1]=0x%x\n", sts->status[1]));
-        DEBUG ((EFI_D_VERBOSE, "sts[2]=0x%x\n", sts->status[2]));
-        Status = EFI_NOT_READY;
-        // wait 1 second and retry, some disk need long time to be ready
-        // and ScsiDisk treat retry over 3 times as error
-        MicroSecondDelay(1000000);
+      iptt = (data & CMPLT_HDR_IPTT_MSK) >> CMPLT_HDR_IPTT_OFF;
+      if (iptt < SLOT_ENTRIES) {
+        slot_complete (hba, iptt, data);
       }
-       // Update read point
-       WRITE_REG32(base, COMPL_Q_0_RD_PTR + (0x14 * queue), w);
-       // Clear int
-       WRITE_REG32(base, OQ_INT_SRC, BIT(queue));
-       slot->used = FALSE;
-       break;
+      rd = (rd + 1) % QUEUE_SLOTS;
+    }
+
+    // Update read point
+    WRITE_REG32(base, COMPL_Q_0_RD_PTR + (0x14 * queue), rd);
+  }
+}
+
+//
+// Report a timed out command to its caller. The command is still owned by
+// the hardware, so its slot is left in use and detached from the caller; it
+// is recycled by slot_complete if the command ever completes.
+// Must be called at TPL_NOTIFY.
+//
+STATIC VOID slot_abandon (struct hisi_hba *hba, UINT32 slot_idx)
+{
+  struct hisi_sas_slot *slot = &hba->slots[slot_idx];
+
+  DEBUG ((EFI_D_ERROR, "sas command timeout iptt=0x%x\n", slot_idx));
+  slot->Packet->HostAdapterStatus =
+    EFI_EXT_SCSI_STATUS_HOST_ADAPTER_TIMEOUT_COMMAND;
+  slot->Packet = NULL;
+  // Do not copy a late bounce buffer into the caller's memory
+  slot->read = FALSE;
+  slot->abandoned = TRUE;
+  hba->stats.errors++;
+  hba->stats.op[slot->opcode].errors++;
+
+  if (slot->Event != NULL) {
+    hba->pending_async--;
+    gBS->SignalEvent (slot->Event);
+  }
+}
+
+//
+// Wait for a blocking request, for at most the packet timeout or CMD_TIMEOUT
+// when the packet sets none.
+//
+STATIC EFI_STATUS wait_cmd (struct hisi_hba *hba, UINT32 slot_idx)
+{
+  struct hisi_sas_slot *slot = &hba->slots[slot_idx];
+  EFI_STATUS Status;
+  BOOLEAN sense;
+  EFI_TPL OldTpl;
+
+  // Wait for dma complete, reaping other outstanding slots meanwhile
+  while (1) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    cq_poll (hba);
+    if (slot->done) {
+      break;
     }
+    if (elapsed_ns (slot->start) > slot->timeout_ns) {
+      slot_abandon (hba, slot_idx);
+      gBS->RestoreTPL (OldTpl);
+      return EFI_TIMEOUT;
+    }
+    gBS->RestoreTPL (OldTpl);
+
     // Wait for status change in polling
     NanoSecondDelay (100);
   }
 
-  if (BufferMap)
-       DmaUnmap (BufferMap);
+  Status = slot->status;
+  sense = slot->sense;
+  slot->used = FALSE;
+  gBS->RestoreTPL (OldTpl);
 
-  p = (UINT8 *)&sts->status[0];
-  if (p[SENSE_DATA_PRES]) {
-    // Disk not ready normal return for ScsiDiskTestUnitReady do next try
-    SensePtr->Sense_Key = EFI_SCSI_SK_NOT_READY;
-    SensePtr->Addnl_Sense_Code = EFI_SCSI_ASC_NOT_READY;
-    SensePtr->Addnl_Sense_Code_Qualifier = EFI_SCSI_ASCQ_IN_PROGRESS;
+  if (Status == EFI_NOT_READY) {
+    // wait 1 second and retry, some disk need long time to be ready
+    // and ScsiDisk treat retry over 3 times as error
+    MicroSecondDelay(1000000);
+  }
+  if (sense) {
     // wait 1 second for disk spin up, refer drivers/scsi/sd.c
     MicroSecondDelay(1000000);
   }
   return Status;
 }
 
+STATIC VOID print_stats (struct hisi_hba *hba)
+{
+  struct hisi_sas_stats *stats = &hba->stats;
+  struct hisi_sas_op_stats *op;
+  UINTN i;
+
+  if (stats->cmds == 0) {
+    return;
+  }
+  DEBUG ((EFI_D_INFO, "sas: %Ld cmds, %Ld errors, avg %Ld ns, max %Ld ns\n",
+    stats->cmds, stats->errors, DivU64x64Remainder (stats->total_ns, stats->cmds, NULL),
+    stats->max_ns));
+  for (i = 0; i < ARRAY_SIZE (stats->op); i++) {
+    op = &stats->op[i];
+    if (op->cmds == 0) {
+      continue;
+    }
+    DEBUG ((EFI_D_INFO, "sas: op 0x%02x: %Ld cmds, %Ld errors, avg %Ld ns, max %Ld ns\n",
+      i, op->cmds, op->errors, DivU64x64Remainder (op->total_ns, op->cmds, NULL),
+      op->max_ns));
+  }
+  DEBUG ((EFI_D_INFO, "sas: %Ld bounced, %Ld allocated, %Ld ns in copies\n",
+    stats->bounced, stats->allocated, stats->copy_ns));
+}
+
+//
+// Probe the devices with an INQUIRY each, one after the other. Only one ITCT
+// entry is set up (MAX_ITCT_ENTRIES), so this is a single command today.
+// Targets that answered are cached for the following scans, a scan only
+// probes again while nothing was found.
+//
+STATIC VOID sas_discover (struct hisi_hba *hba)
+{
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET Packet;
+  EFI_SCSI_INQUIRY_DATA Inquiry;
+  UINT8 Cdb[6];
+  UINT32 slot_idx;
+  EFI_STATUS Status;
+  EFI_TPL OldTpl;
+  int i;
+
+  hba->discovered = FALSE;
+  for (i = 0; i < MAX_ITCT_ENTRIES; i++) {
+    ZeroMem (&Packet, sizeof (Packet));
+    ZeroMem (&Inquiry, sizeof (Inquiry));
+    ZeroMem (Cdb, sizeof (Cdb));
+    Cdb[0] = EFI_SCSI_OP_INQUIRY;
+    Cdb[4] = sizeof (EFI_SCSI_INQUIRY_DATA);
+    Packet.Timeout = INQUIRY_TIMEOUT;
+    Packet.Cdb = Cdb;
+    Packet.CdbLength = sizeof (Cdb);
+    Packet.InDataBuffer = &Inquiry;
+    Packet.InTransferLength = sizeof (EFI_SCSI_INQUIRY_DATA);
+    Packet.DataDirection = EFI_EXT_SCSI_DATA_DIRECTION_READ;
+
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    Status = prepare_cmd (hba, &Packet, NULL, i, &slot_idx);
+    gBS->RestoreTPL (OldTpl);
+    if (!EFI_ERROR (Status)) {
+      Status = wait_cmd (hba, slot_idx);
+    }
+
+    hba->present[i] = !EFI_ERROR (Status) &&
+                      Inquiry.Peripheral_Qualifier == 0 &&
+                      Inquiry.Peripheral_Type != 0x1f;
+    if (hba->present[i]) {
+      hba->discovered = TRUE;
+    }
+  }
+}
+
+STATIC int next_target (struct hisi_hba *hba, int from)
+{
+  int i;
+
+  for (i = from; i < MAX_ITCT_ENTRIES; i++) {
+    if (hba->present[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+//
+// Poll all PHYs together instead of sleeping for the worst case. Once the
+// first link is up, the other PHYs of a wide port get a short settle time.
+// Returns the highest PHY with its link up, or 0 when none came up.
+//
+STATIC int wait_phy_up (UINT32 base)
+{
+  int i, ms, settle = -1, phy_id = 0;
+  UINT32 up = 0;
+
+  for (ms = 0; ms < PHY_UP_TIMEOUT; ms++) {
+    up = 0;
+    for (i = 0; i < PHY_CNT; i++) {
+      if (PHY_READ_REG32(base, CHL_INT2, i) & CHL_INT2_SL_PHY_ENA) {
+        up |= BIT(i);
+      }
+    }
+    if (up != 0 && settle < 0) {
+      settle = ms + PHY_UP_SETTLE;
+    }
+    if (up == BIT(PHY_CNT) - 1 || (settle >= 0 && ms >= settle)) {
+      break;
+    }
+    MicroSecondDelay (1000);
+  }
+
+  for (i = 0; i < PHY_CNT; i++) {
+    if (up & BIT(i)) {
+      phy_id = i;
+    }
+  }
+  return phy_id;
+}
+
+STATIC
+VOID
+EFIAPI
+SasV1PollCompletion (
+  IN EFI_EVENT    Event,
+  IN VOID         *Context
+  )
+{
+  SAS_V1_INFO *SasV1Info = Context;
+  struct hisi_hba *hba = SasV1Info->hba;
+  struct hisi_sas_slot *slot;
+  UINT32 i;
+
+  cq_poll (hba);
+
+  // Fail the non-blocking requests that are overdue
+  for (i = 0; i < SLOT_ENTRIES && hba->pending_async != 0; i++) {
+    slot = &hba->slots[i];
+    if (slot->used && !slot->abandoned && slot->Event != NULL &&
+        elapsed_ns (slot->start) > slot->timeout_ns) {
+      slot_abandon (hba, i);
+    }
+  }
+
+  if (hba->pending_async == 0) {
+    gBS->SetTimer (SasV1Info->TimerEvent, TimerCancel, 0);
+  }
+}
+
 STATIC VOID hisi_sas_v1_init(struct hisi_hba *hba, PLATFORM_SAS_PROTOCOL *plat)
 {
   int i, j;
@@ -614,7 +1059,7 @@ STATIC VOID hisi_sas_v1_init(struct hisi_hba *hba, PLATFORM_SAS_PROTOCOL *plat)
 STATIC VOID sas_init(SAS_V1_INFO *SasV1Info, PLATFORM_SAS_PROTOCOL *plat)
 {
   struct hisi_hba *hba = SasV1Info->hba;
-  int i, s;
+  int i, j, s;
 
   for (i = 0; i < QUEUE_CNT; i++) {
     s = sizeof(struct hisi_sas_cmd_hdr) * QUEUE_SLOTS;
@@ -661,6 +1106,14 @@ STATIC VOID sas_init(SAS_V1_INFO *SasV1Info, PLATFORM_SAS_PROTOCOL *plat)
   hba->slots = AllocateZeroPool (SLOT_ENTRIES * sizeof(struct hisi_sas_slot));
   ASSERT (hba->slots != NULL);
 
+  // Commands that do not fit the pool allocate their own bounce buffer
+  for (i = 0, j = 0; i < ARRAY_SIZE (bounce_cfg); i++) {
+    for (s = 0; s < bounce_cfg[i].count && j < BOUNCE_CNT; s++, j++) {
+      DmaAllocateBuffer (EfiBootServicesData, EFI_SIZE_TO_PAGES (bounce_cfg[i].size), &hba->bounce[j].buf);
+      hba->bounce[j].size = bounce_cfg[i].size;
+    }
+  }
+
   hisi_sas_v1_init(hba, plat);
 }
 
@@ -677,8 +1130,28 @@ SasV1ExtScsiPassThruFunction (
 {
   SAS_V1_INFO *SasV1Info = SAS_FROM_PASS_THRU(This);
   struct hisi_hba *hba = SasV1Info->hba;
+  EFI_STATUS Status;
+  EFI_TPL OldTpl;
+  UINT32 slot_idx;
+
+  if (Target == NULL || Packet == NULL || Target[0] >= MAX_ITCT_ENTRIES) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  Status = prepare_cmd(hba, Packet, Event, Target[0], &slot_idx);
+  if (!EFI_ERROR (Status) && Event != NULL) {
+    // Completion is reaped by the poll timer, armed while requests are queued
+    if (hba->pending_async++ == 0) {
+      gBS->SetTimer (SasV1Info->TimerEvent, TimerPeriodic, ASYNC_POLL_INTERVAL);
+    }
+  }
+  gBS->RestoreTPL (OldTpl);
 
-  return prepare_cmd(hba, Packet);
+  if (EFI_ERROR (Status) || Event != NULL) {
+    return Status;
+  }
+  return wait_cmd(hba, slot_idx);
 }
 
 STATIC
@@ -693,7 +1166,7 @@ SasV1ExtScsiPassThruGetNextTargetLun (
   SAS_V1_INFO *SasV1Info = SAS_FROM_PASS_THRU(This);
   struct hisi_hba *hba = SasV1Info->hba;
   UINT8 ScsiId[TARGET_MAX_BYTES];
-  UINT8 TargetId;
+  int TargetId;
 
   if (*Target == NULL || Lun == NULL) {
     return EFI_INVALID_PARAMETER;
@@ -701,18 +1174,22 @@ SasV1ExtScsiPassThruGetNextTargetLun (
 
   SetMem (ScsiId, TARGET_MAX_BYTES, 0xFF);
 
-  TargetId = (*Target)[0];
-
-  if (TargetId == MAX_TARGET_ID) {
-    return EFI_NOT_FOUND;
-  }
-
   if (CompareMem(*Target, ScsiId, TARGET_MAX_BYTES) == 0) {
-    SetMem (*Target, TARGET_MAX_BYTES,0);
+    // Start of a scan, probe only if no target is known yet
+    if (!hba->discovered) {
+      sas_discover (hba);
+    }
+    TargetId = next_target (hba, 0);
   } else {
-    (*Target)[0] = (UINT8) (hba->LatestTargetId + 1);
+    TargetId = next_target (hba, hba->LatestTargetId + 1);
   }
 
+  if (TargetId < 0) {
+    return EFI_NOT_FOUND;
+  }
+
+  SetMem (*Target, TARGET_MAX_BYTES, 0);
+  (*Target)[0] = (UINT8) TargetId;
   *Lun = 0;
 
   //
@@ -785,8 +1262,33 @@ SasV1ExtScsiPassThruGetNextTarget (
   IN OUT UINT8                           **Target
   )
 {
+  SAS_V1_INFO *SasV1Info = SAS_FROM_PASS_THRU(This);
+  struct hisi_hba *hba = SasV1Info->hba;
+  UINT8 ScsiId[TARGET_MAX_BYTES];
+  int TargetId;
 
-  return EFI_UNSUPPORTED;
+  if (Target == NULL || *Target == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  SetMem (ScsiId, TARGET_MAX_BYTES, 0xFF);
+
+  if (CompareMem(*Target, ScsiId, TARGET_MAX_BYTES) == 0) {
+    if (!hba->discovered) {
+      sas_discover (hba);
+    }
+    TargetId = next_target (hba, 0);
+  } else {
+    TargetId = next_target (hba, (*Target)[0] + 1);
+  }
+
+  if (TargetId < 0) {
+    return EFI_NOT_FOUND;
+  }
+
+  SetMem (*Target, TARGET_MAX_BYTES, 0);
+  (*Target)[0] = (UINT8) TargetId;
+  return EFI_SUCCESS;
 }
 
 STATIC EFI_EXT_SCSI_PASS_THRU_PROTOCOL SasV1ExtScsiPassThruProtocolTemplate = {
@@ -852,7 +1354,7 @@ SasDriverBindingStart (
   SAS_V1_INFO *SasV1Info = NULL;
   SAS_V1_TRANSPORT_DEVICE_PATH  *DevicePath;
   UINT32 val, base;
-  int i, phy_id = 0;
+  int phy_id = 0;
   struct hisi_sas_itct *itct;
   struct hisi_hba *hba;
 
@@ -884,15 +1386,7 @@ SasDriverBindingStart (
   sas_init(SasV1Info, plat);
 
   // Wait for sas controller phyup happen
-  MicroSecondDelay(100000);
-
-  for (i = 0; i < PHY_CNT; i++) {
-    val = PHY_READ_REG32(base, CHL_INT2, i);
-
-    if (val & CHL_INT2_SL_PHY_ENA) {
-      phy_id = i;
-    }
-  }
+  phy_id = wait_phy_up (base);
 
   itct = &hba->itct[0]; //device_id = 0
 
@@ -922,7 +1416,9 @@ SasDriverBindingStart (
 
   CopyMem (&SasV1Info->ExtScsiPassThru, &SasV1ExtScsiPassThruProtocolTemplate, sizeof (EFI_EXT_SCSI_PASS_THRU_PROTOCOL));
   SasV1Info->ExtScsiPassThruMode.AdapterId = 2;
-  SasV1Info->ExtScsiPassThruMode.Attributes = EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_PHYSICAL | EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_LOGICAL;
+  SasV1Info->ExtScsiPassThruMode.Attributes = EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_PHYSICAL |
+                                              EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_LOGICAL |
+                                              EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_NONBLOCKIO;
   SasV1Info->ExtScsiPassThruMode.IoAlign  = 64; //cache line align
   SasV1Info->ExtScsiPassThru.Mode = &SasV1Info->ExtScsiPassThruMode;
 
@@ -933,6 +1429,15 @@ SasDriverBindingStart (
   ASSERT (DevicePath != NULL);
   SasV1Info->DevicePath = DevicePath;
 
+  Status = gBS->CreateEvent (
+                EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                TPL_NOTIFY,
+                SasV1PollCompletion,
+                SasV1Info,
+                &SasV1Info->TimerEvent
+                );
+  ASSERT_EFI_ERROR (Status);
+
   CopyMem (&DevicePath->Vendor.Guid, &gPlatformSasProtocolGuid, sizeof (EFI_GUID));
   DevicePath->PhysBase = base;
   SetDevicePathNodeLength (&DevicePath->Vendor,
@@ -992,8 +1497,11 @@ SasDriverBindingStop (
            Controller
            );
 
+    gBS->SetTimer (SasV1Info->TimerEvent, TimerCancel, 0);
     gBS->CloseEvent (SasV1Info->TimerEvent);
 
+    print_stats (SasV1Info->hba);
+
     for (i = 0; i < QUEUE_CNT; i++) {
       s = sizeof(struct hisi_sas_cmd_hdr) * QUEUE_SLOTS;
       DmaFreeBuffer(EFI_SIZE_TO_PAGES (s), (VOID *)SasV1Info->hba->cmd_hdr[i]);
@@ -1014,6 +1522,12 @@ SasDriverBindingStop (
     s = MAX_ITCT_ENTRIES * sizeof(struct hisi_sas_itct);
     DmaFreeBuffer(EFI_SIZE_TO_PAGES (s), (VOID *)SasV1Info->hba->itct);
 
+    for (i = 0; i < BOUNCE_CNT; i++) {
+      if (SasV1Info->hba->bounce[i].buf) {
+        DmaFreeBuffer(EFI_SIZE_TO_PAGES (SasV1Info->hba->bounce[i].size), SasV1Info->hba->bounce[i].buf);
+      }
+    }
+
     FreePool (SasV1Info->hba->slots);
     FreePool (SasV1Info->hba);
     FreePool (SasV1Info);
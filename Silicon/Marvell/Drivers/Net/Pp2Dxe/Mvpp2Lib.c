@@ -3478,7 +3478,7 @@ Mvpp2RxqHwInit (
   Mvpp2RxqOffsetSet (Port, Rxq->Id, MVPP2_RXQ_OFFSET);
 
   /* Set coalescing pkts and time */
-  Mvpp2RxPktsCoalSet (Port, Rxq, MVPP2_RX_COAL_PKTS);
+  Mvpp2RxPktsCoalSet (Port, Rxq, Rxq->PktsCoal);
   Mvpp2RxTimeCoalSet (Port, Rxq, Rxq->TimeCoal);
 
   /* Add number of descriptors ready for receiving packets */
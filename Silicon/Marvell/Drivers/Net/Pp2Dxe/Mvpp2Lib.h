@@ -41,7 +41,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /* number of RXQs used by single Port */
 STATIC INT32 RxqNumber = 1;
 /* number of TXQs used by single Port */
-STATIC INT32 TxqNumber = 1;
+STATIC INT32 TxqNumber = FixedPcdGet8 (PcdPp2TxqNumber);
 
 VOID
 Mvpp2PrsMacPromiscSet (
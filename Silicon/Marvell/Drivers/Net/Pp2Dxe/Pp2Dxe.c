@@ -126,7 +126,7 @@ EFI_SIMPLE_NETWORK_MODE Pp2SnpModeTemplate = {
   },                                                    // Permanent Address
   NET_IFTYPE_ETHERNET,                                  // IfType
   TRUE,                                                 // MacAddressChangeable
-  FALSE,                                                // MultipleTxSupported
+  TRUE,                                                 // MultipleTxSupported
   TRUE,                                                 // MediaPresentSupported
   FALSE                                                 // MediaPresent
 };
@@ -136,40 +136,297 @@ EFI_SIMPLE_NETWORK_MODE Pp2SnpModeTemplate = {
 STATIC
 EFI_STATUS
 QueueInsert (
-  IN PP2DXE_CONTEXT *Pp2Context,
+  IN PP2DXE_TXQ_STATE *TxqState,
   IN VOID *Buffer
   )
 {
 
-  if (QueueNext (Pp2Context->CompletionQueueTail) == Pp2Context->CompletionQueueHead) {
+  if (QueueNext (TxqState->CompletionQueueTail) == TxqState->CompletionQueueHead) {
     return EFI_OUT_OF_RESOURCES;
   }
 
-  Pp2Context->CompletionQueue[Pp2Context->CompletionQueueTail] = Buffer;
-  Pp2Context->CompletionQueueTail = QueueNext (Pp2Context->CompletionQueueTail);
+  TxqState->CompletionQueue[TxqState->CompletionQueueTail] = Buffer;
+  TxqState->CompletionQueueTail = QueueNext (TxqState->CompletionQueueTail);
 
   return EFI_SUCCESS;
 }
 
+/*
+ * Completion queue layout:
+ * [Head, Sent) - buffers transmitted by HW, to be returned by GetStatus
+ * [Sent, Tail) - buffers still owned by HW TXQ
+ */
 STATIC
 VOID *
 QueueRemove (
-  IN PP2DXE_CONTEXT *Pp2Context
+  IN PP2DXE_TXQ_STATE *TxqState
   )
 {
   VOID *Buffer;
 
-  if (Pp2Context->CompletionQueueTail == Pp2Context->CompletionQueueHead) {
+  if (TxqState->CompletionQueueSent == TxqState->CompletionQueueHead) {
     return NULL;
   }
 
-  Buffer = Pp2Context->CompletionQueue[Pp2Context->CompletionQueueHead];
-  Pp2Context->CompletionQueue[Pp2Context->CompletionQueueHead] = NULL;
-  Pp2Context->CompletionQueueHead = QueueNext (Pp2Context->CompletionQueueHead);
+  Buffer = TxqState->CompletionQueue[TxqState->CompletionQueueHead];
+  TxqState->CompletionQueue[TxqState->CompletionQueueHead] = NULL;
+  TxqState->CompletionQueueHead = QueueNext (TxqState->CompletionQueueHead);
+
+  return Buffer;
+}
+
+/*
+ * Queues may be driven from any CPU, so they are serialized with
+ * spinlocks rather than TPL. Interrupts are masked while a lock is held,
+ * so that the owner cannot be preempted by another user of the same queue.
+ */
+STATIC
+BOOLEAN
+Pp2DxeLock (
+  IN SPIN_LOCK *Lock
+  )
+{
+  BOOLEAN InterruptState;
+
+  InterruptState = SaveAndDisableInterrupts ();
+  AcquireSpinLock (Lock);
+
+  return InterruptState;
+}
+
+STATIC
+VOID
+Pp2DxeUnlock (
+  IN SPIN_LOCK *Lock,
+  IN BOOLEAN InterruptState
+  )
+{
+  ReleaseSpinLock (Lock);
+  SetInterruptState (InterruptState);
+}
+
+/* Release buffer to BM, release registers are shared by all CPUs */
+STATIC
+VOID
+Pp2DxeBmPoolPut (
+  IN MVPP2_SHARED *Mvpp2Shared,
+  IN INT32 Pool,
+  IN UINTN PhysAddr,
+  IN UINTN VirtAddr
+  )
+{
+  BOOLEAN InterruptState;
+
+  InterruptState = Pp2DxeLock (&Mvpp2Shared->Lock);
+  Mvpp2BmPoolPut(Mvpp2Shared, Pool, PhysAddr, VirtAddr);
+  Pp2DxeUnlock (&Mvpp2Shared->Lock, InterruptState);
+}
+
+/*
+ * Mark buffers of descriptors already sent by HW as completed.
+ * TXQ lock must be held by the caller.
+ */
+STATIC
+VOID
+Pp2DxeTxqReclaim (
+  IN PP2DXE_CONTEXT *Pp2Context,
+  IN UINTN Queue
+  )
+{
+  PP2DXE_PORT *Port = &Pp2Context->Port;
+  MVPP2_TX_QUEUE *Txq = &Port->Txqs[Queue];
+  PP2DXE_TXQ_STATE *TxqState = &Pp2Context->TxqState[Queue];
+  INTN TxSent;
+
+  if (Txq->count == 0) {
+    return;
+  }
+
+  TxSent = Mvpp2TxqSentDescProc(Port, Txq);
+  ASSERT (TxSent <= Txq->count);
+
+  while (TxSent-- > 0) {
+    ASSERT (TxqState->CompletionQueueSent != TxqState->CompletionQueueTail);
+    TxqState->CompletionQueueSent = QueueNext (TxqState->CompletionQueueSent);
+    Txq->count--;
+  }
+}
+
+/* Get buffer of a frame already transmitted from the logical TXQ */
+STATIC
+VOID *
+Pp2DxeTxqRecycle (
+  IN PP2DXE_CONTEXT *Pp2Context,
+  IN UINTN Queue
+  )
+{
+  PP2DXE_TXQ_STATE *TxqState = &Pp2Context->TxqState[Queue];
+  BOOLEAN InterruptState;
+  VOID *Buffer;
+
+  InterruptState = Pp2DxeLock (&TxqState->Lock);
+  Pp2DxeTxqReclaim (Pp2Context, Queue);
+  Buffer = QueueRemove (TxqState);
+  Pp2DxeUnlock (&TxqState->Lock, InterruptState);
 
   return Buffer;
 }
 
+/*
+ * Get TX descriptor command bits requesting HW to calculate checksums of the
+ * frame. Only untagged and single VLAN tagged IP frames are handled.
+ */
+STATIC
+UINT32
+Pp2DxeTxCsumCommand (
+  IN UINT8 *Packet,
+  IN UINTN PacketSize
+  )
+{
+  UINTN L3Offset = MV_ETH_HLEN;
+  UINT16 EtherType;
+  UINT32 IpHdrLen;
+  UINT8 L4Proto;
+  INT32 CsumL3Proto, CsumL4Proto;
+
+  if (PacketSize < MV_ETH_HLEN + MV_VLAN_HLEN || PacketSize > MVPP2_TX_CSUM_MAX_SIZE) {
+    goto NoCsum;
+  }
+
+  EtherType = NTOHS (*(UINT16 *)(Packet + L3Offset - 2));
+  if (EtherType == MV_ETH_TYPE_VLAN) {
+    L3Offset += MV_VLAN_HLEN;
+    EtherType = NTOHS (*(UINT16 *)(Packet + L3Offset - 2));
+  }
+
+  if (EtherType == MV_ETH_TYPE_IP4) {
+    if (PacketSize < L3Offset + MV_IP4_MIN_HLEN) {
+      goto NoCsum;
+    }
+
+    IpHdrLen = Packet[L3Offset] & 0xf;
+    L4Proto = Packet[L3Offset + 9];
+    CsumL3Proto = MV_ETH_P_IP;
+
+    /* L4 checksum of IP fragments can't be calculated by HW */
+    if (NTOHS (*(UINT16 *)(Packet + L3Offset + 6)) & MV_IP4_FRAG_MASK) {
+      L4Proto = 0;
+    }
+  } else if (EtherType == MV_ETH_TYPE_IP6) {
+    if (PacketSize < L3Offset + MV_IP6_HLEN) {
+      goto NoCsum;
+    }
+
+    IpHdrLen = MV_IP6_HLEN / 4;
+    L4Proto = Packet[L3Offset + 6];
+    CsumL3Proto = MV_ETH_P_IPV6;
+  } else {
+    goto NoCsum;
+  }
+
+  /* Mvpp2TxqDescCsum takes protocols in the MV_ETH_P_* / MV_IPPR_* encoding */
+  if (L4Proto == MV_IP_PROTO_TCP) {
+    CsumL4Proto = MV_IPPR_TCP;
+  } else if (L4Proto == MV_IP_PROTO_UDP) {
+    CsumL4Proto = MV_IPPR_UDP;
+  } else {
+    CsumL4Proto = -1;
+  }
+
+  return Mvpp2TxqDescCsum (L3Offset, Mvpp2SwapBytes16 (CsumL3Proto), IpHdrLen, CsumL4Proto);
+
+NoCsum:
+  return MVPP2_TXD_IP_CSUM_DISABLE | MVPP2_TXD_L4_CSUM_NOT;
+}
+
+/*
+ * Put a complete frame on the logical TXQ. Do not wait for HW - the buffer
+ * is returned through the TXQ completion queue once it is sent.
+ */
+STATIC
+EFI_STATUS
+Pp2DxeTxqSend (
+  IN PP2DXE_CONTEXT *Pp2Context,
+  IN UINTN Queue,
+  IN VOID *Buffer,
+  IN UINTN BufferSize
+  )
+{
+  PP2DXE_PORT *Port = &Pp2Context->Port;
+  MVPP2_SHARED *Mvpp2Shared = Port->Priv;
+  MVPP2_TX_QUEUE *AggrTxq = Mvpp2Shared->AggrTxqs;
+  MVPP2_TX_QUEUE *Txq = &Port->Txqs[Queue];
+  PP2DXE_TXQ_STATE *TxqState = &Pp2Context->TxqState[Queue];
+  MVPP2_TX_DESC *TxDesc;
+  BOOLEAN InterruptState;
+  EFI_STATUS Status;
+  UINT32 Command;
+
+  if (Pp2Context->ChecksumOffload) {
+    Command = Pp2DxeTxCsumCommand (Buffer, BufferSize);
+  } else {
+    Command = MVPP2_TXD_IP_CSUM_DISABLE | MVPP2_TXD_L4_CSUM_NOT;
+  }
+
+  InvalidateDataCacheRange (Buffer, BufferSize);
+
+  InterruptState = Pp2DxeLock (&TxqState->Lock);
+
+  /* Try to free TXQ slots, if all of them are occupied by pending frames */
+  if (Txq->count >= Txq->Size) {
+    Pp2DxeTxqReclaim (Pp2Context, Queue);
+    if (Txq->count >= Txq->Size) {
+      Status = EFI_NOT_READY;
+      goto Full;
+    }
+  }
+
+  /* Completion queue is full if the caller does not recycle buffers */
+  if (QueueNext (TxqState->CompletionQueueTail) == TxqState->CompletionQueueHead) {
+    Status = EFI_NOT_READY;
+    goto Full;
+  }
+
+  /* Aggregated TXQ is shared by all ports and queues */
+  AcquireSpinLock (&Mvpp2Shared->Lock);
+
+  if (Mvpp2AggrDescNumCheck(Mvpp2Shared, AggrTxq, 1, 0) != 0) {
+    ReleaseSpinLock (&Mvpp2Shared->Lock);
+    Status = EFI_NOT_READY;
+    goto Full;
+  }
+
+  /* Fetch next descriptor */
+  TxDesc = Mvpp2TxqNextDescGet(AggrTxq);
+
+  /* Set descriptor fields */
+  TxDesc->command = Command | MVPP2_TXD_F_DESC | MVPP2_TXD_L_DESC;
+  TxDesc->DataSize = BufferSize;
+  TxDesc->PacketOffset = (PhysAddrT)Buffer & MVPP2_TX_DESC_ALIGN;
+  Mvpp2x2TxdescPhysAddrSet((PhysAddrT)Buffer & ~MVPP2_TX_DESC_ALIGN, TxDesc);
+  TxDesc->PhysTxq = Txq->Id;
+
+  /* Issue send */
+  Mvpp2AggrTxqPendDescAdd(Port, 1);
+  AggrTxq->count++;
+
+  ReleaseSpinLock (&Mvpp2Shared->Lock);
+
+  Status = QueueInsert (TxqState, Buffer);
+  ASSERT_EFI_ERROR (Status);
+  Txq->count++;
+  TxqState->Queued++;
+  goto Unlock;
+
+Full:
+  TxqState->QueueFull++;
+
+Unlock:
+  Pp2DxeUnlock (&TxqState->Lock, InterruptState);
+
+  return Status;
+}
+
 STATIC
 EFI_STATUS
 Pp2DxeBmPoolInit (
@@ -431,12 +688,11 @@ Pp2DxeLatePortInitialize (
     return EFI_OUT_OF_RESOURCES;
   }
 
-  /* Use preallocated area */
-  Port->Txqs[0].Descs = Mvpp2Shared->BufferLocation.TxDescs[Port->Id];
-
   for (Queue = 0; Queue < TxqNumber; Queue++) {
     MVPP2_TX_QUEUE *Txq = &Port->Txqs[Queue];
 
+    /* Use preallocated area */
+    Txq->Descs = Mvpp2Shared->BufferLocation.TxDescs[Port->Id] + Queue * MVPP2_MAX_TXD;
     Txq->Id = Mvpp2TxqPhys(Port->Id, Queue);
     Txq->LogId = Queue;
     Txq->Size = Port->TxRingSize;
@@ -450,11 +706,13 @@ Pp2DxeLatePortInitialize (
 
   Port->Rxqs[0].Descs = Mvpp2Shared->BufferLocation.RxDescs[Port->Id];
 
-  for (Queue = 0; Queue < TxqNumber; Queue++) {
+  for (Queue = 0; Queue < RxqNumber; Queue++) {
     MVPP2_RX_QUEUE *Rxq = &Port->Rxqs[Queue];
 
     Rxq->Id = Queue + Port->FirstRxq;
     Rxq->Size = Port->RxRingSize;
+    Rxq->PktsCoal = PcdGet32 (PcdPp2RxCoalPkts);
+    Rxq->TimeCoal = PcdGet32 (PcdPp2RxCoalUsec);
   }
 
   Mvpp2IngressDisable(Port);
@@ -472,6 +730,7 @@ Pp2DxeLateInitialize (
 {
   PP2DXE_PORT *Port = &Pp2Context->Port;
   EFI_STATUS Status;
+  INTN Queue;
 
   if (!Pp2Context->LateInitialized) {
     /* Full init on first call */
@@ -481,9 +740,11 @@ Pp2DxeLateInitialize (
       return Status;
     }
 
-    /* Attach pool to Rxq */
-    Mvpp2RxqLongPoolSet(Port, 0, Port->Id);
-    Mvpp2RxqShortPoolSet(Port, 0, Port->Id);
+    /* Attach pool to all Rxqs */
+    for (Queue = 0; Queue < RxqNumber; Queue++) {
+      Mvpp2RxqLongPoolSet(Port, Queue, Port->Id);
+      Mvpp2RxqShortPoolSet(Port, Queue, Port->Id);
+    }
 
     /*
      * Mark this port being fully initialized,
@@ -541,6 +802,29 @@ Pp2DxePhyInitialize (
   return EFI_SUCCESS;
 }
 
+/* Return buffers released while the port was down to BM */
+STATIC
+VOID
+Pp2DxeRxLoansReclaim (
+  IN PP2DXE_CONTEXT *Pp2Context
+  )
+{
+  PP2DXE_RX_LOAN *RxLoan;
+  BOOLEAN InterruptState;
+  UINTN Index;
+
+  InterruptState = Pp2DxeLock (&Pp2Context->RxLoanLock);
+  for (Index = 0; Index < PP2DXE_MAX_RX_LOANS; Index++) {
+    RxLoan = &Pp2Context->RxLoans[Index];
+    if (RxLoan->InUse && RxLoan->Parked) {
+      Pp2DxeBmPoolPut(Pp2Context->Port.Priv, RxLoan->PoolId, RxLoan->PhysAddr, RxLoan->VirtAddr);
+      RxLoan->Parked = FALSE;
+      RxLoan->InUse = FALSE;
+    }
+  }
+  Pp2DxeUnlock (&Pp2Context->RxLoanLock, InterruptState);
+}
+
 EFI_STATUS
 EFIAPI
 Pp2DxeSnpInitialize (
@@ -580,6 +864,7 @@ Pp2DxeSnpInitialize (
   This->Mode->State = EfiSimpleNetworkInitialized;
 
   if (Pp2Context->Initialized) {
+    Pp2DxeRxLoansReclaim (Pp2Context);
     ReturnUnlock(SavedTpl, EFI_SUCCESS);
   }
 
@@ -671,6 +956,7 @@ Pp2DxeHalt (
   MVPP2_SHARED *Mvpp2Shared = Pp2Context->Port.Priv;
   STATIC BOOLEAN CommonPartHalted = FALSE;
   INTN Index;
+  INTN Queue;
 
   if (!CommonPartHalted) {
     for (Index = 0; Index < MVPP2_MAX_PORT; Index++) {
@@ -680,12 +966,17 @@ Pp2DxeHalt (
     CommonPartHalted = TRUE;
   }
 
-  Mvpp2TxqDrainSet(Port, 0, TRUE);
+  for (Queue = 0; Queue < TxqNumber; Queue++) {
+    Mvpp2TxqDrainSet(Port, Queue, TRUE);
+  }
   Mvpp2IngressDisable(Port);
   Mvpp2EgressDisable(Port);
 
   MvGop110PortEventsMask(Port);
   MvGop110PortDisable(Port);
+
+  /* BM is stopped, fail all further requests */
+  Pp2Context->Snp.Mode->State = EfiSimpleNetworkStopped;
 }
 
 EFI_STATUS
@@ -797,6 +1088,56 @@ Pp2SnpStationAddress (
   return EFI_SUCCESS;
 }
 
+/* Read a 64-bit MIB counter, low word first */
+STATIC
+UINT64
+Pp2DxeMibRead64 (
+  IN PP2DXE_PORT *Port,
+  IN UINT32 Offset
+  )
+{
+  UINT64 Value;
+
+  Value = Mvpp2MibRead (Port, Offset);
+  Value |= (UINT64)Mvpp2MibRead (Port, Offset + 4) << 32;
+
+  return Value;
+}
+
+/*
+ * Fold the port's MIB counters into the accumulated totals. HW counters are
+ * cleared on read, so they must not be read anywhere else.
+ */
+STATIC
+VOID
+Pp2DxeMibUpdate (
+  IN PP2DXE_CONTEXT *Pp2Context
+  )
+{
+  PP2DXE_PORT *Port = &Pp2Context->Port;
+  PP2DXE_MIB_COUNTERS *Mib = &Pp2Context->Mib;
+
+  Mib->GoodOctetsRcvd += Pp2DxeMibRead64 (Port, MVPP2_MIB_GOOD_OCTETS_RCVD);
+  Mib->BadOctetsRcvd += Mvpp2MibRead (Port, MVPP2_MIB_BAD_OCTETS_RCVD);
+  Mib->CrcErrorsSent += Mvpp2MibRead (Port, MVPP2_MIB_CRC_ERRORS_SENT);
+  Mib->UnicastFramesRcvd += Mvpp2MibRead (Port, MVPP2_MIB_UNICAST_FRAMES_RCVD);
+  Mib->BroadcastFramesRcvd += Mvpp2MibRead (Port, MVPP2_MIB_BROADCAST_FRAMES_RCVD);
+  Mib->MulticastFramesRcvd += Mvpp2MibRead (Port, MVPP2_MIB_MULTICAST_FRAMES_RCVD);
+  Mib->GoodOctetsSent += Pp2DxeMibRead64 (Port, MVPP2_MIB_GOOD_OCTETS_SENT);
+  Mib->UnicastFramesSent += Mvpp2MibRead (Port, MVPP2_MIB_UNICAST_FRAMES_SENT);
+  Mib->MulticastFramesSent += Mvpp2MibRead (Port, MVPP2_MIB_MULTICAST_FRAMES_SENT);
+  Mib->BroadcastFramesSent += Mvpp2MibRead (Port, MVPP2_MIB_BROADCAST_FRAMES_SENT);
+  Mib->RxFifoOverrun += Mvpp2MibRead (Port, MVPP2_MIB_RX_FIFO_OVERRUN);
+  Mib->UndersizeRcvd += Mvpp2MibRead (Port, MVPP2_MIB_UNDERSIZE_RCVD);
+  Mib->FragmentsRcvd += Mvpp2MibRead (Port, MVPP2_MIB_FRAGMENTS_RCVD);
+  Mib->OversizeRcvd += Mvpp2MibRead (Port, MVPP2_MIB_OVERSIZE_RCVD);
+  Mib->JabberRcvd += Mvpp2MibRead (Port, MVPP2_MIB_JABBER_RCVD);
+  Mib->MacRecError += Mvpp2MibRead (Port, MVPP2_MIB_MAC_REC_ERROR);
+  Mib->BadCrcEvent += Mvpp2MibRead (Port, MVPP2_MIB_BAD_CRC_EVENT);
+  Mib->Collision += Mvpp2MibRead (Port, MVPP2_MIB_COLLISION);
+  Mib->LateCollision += Mvpp2MibRead (Port, MVPP2_MIB_LATE_COLLISION);
+}
+
 EFI_STATUS
 EFIAPI
 Pp2SnpNetStat (
@@ -806,7 +1147,82 @@ Pp2SnpNetStat (
   OUT EFI_NETWORK_STATISTICS     *StatisticsTable  OPTIONAL
   )
 {
-  return EFI_UNSUPPORTED;
+  PP2DXE_CONTEXT *Pp2Context = INSTANCE_FROM_SNP(This);
+  PP2DXE_MIB_COUNTERS *Mib = &Pp2Context->Mib;
+  UINT32 State = This->Mode->State;
+  EFI_NETWORK_STATISTICS Stats;
+  EFI_STATUS Status = EFI_SUCCESS;
+  EFI_TPL SavedTpl;
+
+  if ((StatisticsSize == NULL) != (StatisticsTable == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (!Reset && StatisticsSize == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  /* Serialize access to data and registers */
+  SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  /* Check that driver was started and initialised */
+  if (State != EfiSimpleNetworkInitialized) {
+    switch (State) {
+    case EfiSimpleNetworkStopped:
+      DEBUG((DEBUG_WARN, "Pp2Dxe%d: not started\n", Pp2Context->Instance));
+      ReturnUnlock (SavedTpl, EFI_NOT_STARTED);
+    case EfiSimpleNetworkStarted:
+    /* Fall through */
+    default:
+      DEBUG((DEBUG_ERROR, "Pp2Dxe%d: wrong state\n", Pp2Context->Instance));
+      ReturnUnlock (SavedTpl, EFI_DEVICE_ERROR);
+    }
+  }
+
+  Pp2DxeMibUpdate (Pp2Context);
+
+  if (StatisticsSize != NULL) {
+    /* Statistics not kept by HW are reported as all ones */
+    SetMem (&Stats, sizeof (Stats), 0xFF);
+
+    Stats.RxUnicastFrames = Mib->UnicastFramesRcvd;
+    Stats.RxBroadcastFrames = Mib->BroadcastFramesRcvd;
+    Stats.RxMulticastFrames = Mib->MulticastFramesRcvd;
+    Stats.RxGoodFrames = Mib->UnicastFramesRcvd + Mib->BroadcastFramesRcvd +
+                         Mib->MulticastFramesRcvd;
+    Stats.RxUndersizeFrames = Mib->UndersizeRcvd + Mib->FragmentsRcvd;
+    Stats.RxOversizeFrames = Mib->OversizeRcvd + Mib->JabberRcvd;
+    Stats.RxCrcErrorFrames = Mib->BadCrcEvent;
+    Stats.RxTotalFrames = Stats.RxGoodFrames + Stats.RxUndersizeFrames +
+                          Stats.RxOversizeFrames + Mib->MacRecError +
+                          Mib->BadCrcEvent;
+    Stats.RxDroppedFrames = Mib->RxFifoOverrun + Pp2Context->RxqState.Dropped -
+                            Pp2Context->RxDroppedAtReset;
+    Stats.RxTotalBytes = Mib->GoodOctetsRcvd + Mib->BadOctetsRcvd;
+
+    Stats.TxUnicastFrames = Mib->UnicastFramesSent;
+    Stats.TxBroadcastFrames = Mib->BroadcastFramesSent;
+    Stats.TxMulticastFrames = Mib->MulticastFramesSent;
+    Stats.TxGoodFrames = Mib->UnicastFramesSent + Mib->BroadcastFramesSent +
+                         Mib->MulticastFramesSent;
+    Stats.TxCrcErrorFrames = Mib->CrcErrorsSent;
+    Stats.TxTotalFrames = Stats.TxGoodFrames + Mib->CrcErrorsSent;
+    Stats.TxTotalBytes = Mib->GoodOctetsSent;
+    Stats.Collisions = Mib->Collision + Mib->LateCollision;
+
+    CopyMem (StatisticsTable, &Stats, MIN (*StatisticsSize, sizeof (Stats)));
+    if (*StatisticsSize < sizeof (Stats)) {
+      Status = EFI_BUFFER_TOO_SMALL;
+    }
+    *StatisticsSize = sizeof (Stats);
+  }
+
+  if (Reset) {
+    ZeroMem (Mib, sizeof (*Mib));
+    Pp2Context->RxDroppedAtReset = Pp2Context->RxqState.Dropped;
+  }
+
+  ReturnUnlock (SavedTpl, Status);
 }
 
 EFI_STATUS
@@ -860,8 +1276,9 @@ Pp2SnpGetStatus (
   }
   Snp->Mode->MediaPresent = LinkUp;
 
+  /* SNP uses the first TXQ */
   if (TxBuf != NULL) {
-    *TxBuf = QueueRemove (Pp2Context);
+    *TxBuf = Pp2DxeTxqRecycle (Pp2Context, 0);
   }
 
   ReturnUnlock(SavedTpl, EFI_SUCCESS);
@@ -880,13 +1297,7 @@ Pp2SnpTransmit (
   )
 {
   PP2DXE_CONTEXT *Pp2Context = INSTANCE_FROM_SNP(This);
-  PP2DXE_PORT *Port = &Pp2Context->Port;
-  MVPP2_SHARED *Mvpp2Shared = Pp2Context->Port.Priv;
-  MVPP2_TX_QUEUE *AggrTxq = Mvpp2Shared->AggrTxqs;
-  MVPP2_TX_DESC *TxDesc;
   EFI_STATUS Status;
-  INTN PollingCount;
-  INTN TxSent;
   UINT8 *DataPtr = Buffer;
   UINT16 EtherType;
   UINT32 State = This->Mode->State;
@@ -924,17 +1335,9 @@ Pp2SnpTransmit (
     ReturnUnlock(SavedTpl, EFI_NOT_READY);
   }
 
-  EtherType = HTONS (*EtherTypePtr);
-
-  /* Fetch next descriptor */
-  TxDesc = Mvpp2TxqNextDescGet(AggrTxq);
-
-  if (!TxDesc) {
-    DEBUG((DEBUG_ERROR, "No tx descriptor to use\n"));
-    ReturnUnlock(SavedTpl, EFI_OUT_OF_RESOURCES);
-  }
-
   if (HeaderSize != 0) {
+    EtherType = HTONS (*EtherTypePtr);
+
     CopyMem(DataPtr, DestAddr, NET_ETHER_ADDR_LEN);
 
     if (SrcAddr != NULL)
@@ -945,51 +1348,96 @@ Pp2SnpTransmit (
     CopyMem(DataPtr + NET_ETHER_ADDR_LEN * 2, &EtherType, 2);
   }
 
-  /* Set descriptor fields */
-  TxDesc->command =  MVPP2_TXD_IP_CSUM_DISABLE | MVPP2_TXD_L4_CSUM_NOT |
-                     MVPP2_TXD_F_DESC | MVPP2_TXD_L_DESC;
-  TxDesc->DataSize = BufferSize;
-  TxDesc->PacketOffset = (PhysAddrT)DataPtr & MVPP2_TX_DESC_ALIGN;
-  Mvpp2x2TxdescPhysAddrSet((PhysAddrT)DataPtr & ~MVPP2_TX_DESC_ALIGN, TxDesc);
-  TxDesc->PhysTxq = Mvpp2TxqPhys(Port->Id, 0);
+  /*
+   * SNP uses the first TXQ. Buffer is returned via GetStatus
+   * once HW reports it as sent.
+   */
+  Status = Pp2DxeTxqSend (Pp2Context, 0, DataPtr, BufferSize);
 
-  InvalidateDataCacheRange (DataPtr, BufferSize);
+  ReturnUnlock (SavedTpl, Status);
+}
 
-  /* Issue send */
-  Mvpp2AggrTxqPendDescAdd(Port, 1);
+/*
+ * Get number of received descriptors ready to be processed.
+ * HW is queried only once the previous batch is drained.
+ * Caller must be running at TPL_CALLBACK.
+ */
+STATIC
+INTN
+Pp2DxeRxqPendingGet (
+  IN PP2DXE_CONTEXT *Pp2Context
+  )
+{
+  PP2DXE_PORT *Port = &Pp2Context->Port;
+  MVPP2_RX_QUEUE *Rxq = &Port->Rxqs[0];
+  PP2DXE_RXQ_STATE *RxqState = &Pp2Context->RxqState;
+  UINT64 Now;
+  INTN Received;
 
-  /*
-   * Egress processing:
-   * Wait until packet is passed from per-cpu aggregated queue
-   * to physical per-port TXQ.
-   */
-  PollingCount = 0;
-  TxSent = Mvpp2AggrTxqPendDescNumGet(Mvpp2Shared, 0);
-  do {
-    if (PollingCount++ > MVPP2_TX_SEND_MAX_POLLING_COUNT) {
-      DEBUG((DEBUG_ERROR, "Pp2Dxe: transmit polling failed\n"));
-      ReturnUnlock(SavedTpl, EFI_TIMEOUT);
+  if (RxqState->PendingCount != 0) {
+    return RxqState->PendingCount;
+  }
+
+  Received = Mvpp2RxqReceived(Port, Rxq->Id);
+  if (Received == 0) {
+    return 0;
+  }
+
+  /* Hold frames back until enough of them are collected, or the oldest one times out */
+  if (Rxq->TimeCoal != 0 && Received < Rxq->PktsCoal) {
+    Now = GetTimeInNanoSecond (GetPerformanceCounter ());
+    if (RxqState->CoalStart == 0) {
+      RxqState->CoalStart = Now;
+      return 0;
     }
-    TxSent = Mvpp2AggrTxqPendDescNumGet(Mvpp2Shared, 0);
-  } while (TxSent);
-
-  /* Wait for packet to be transmitted by hardware. */
-  PollingCount = 0;
-  TxSent = Mvpp2TxqSentDescProc(Port, &Port->Txqs[0]);
-  while (!TxSent) {
-    if (PollingCount++ > MVPP2_TX_SEND_MAX_POLLING_COUNT) {
-      DEBUG((DEBUG_ERROR, "Pp2Dxe: transmit polling failed\n"));
-      ReturnUnlock(SavedTpl, EFI_TIMEOUT);
+
+    if (Now - RxqState->CoalStart < (UINT64)Rxq->TimeCoal * 1000) {
+      return 0;
     }
-    TxSent = Mvpp2TxqSentDescProc(Port, &Port->Txqs[0]);
   }
 
-  /*
-   * At this point TxSent has increased - HW sent the packet
-   * Add buffer to completion queue and return.
-   */
-  Status = QueueInsert (Pp2Context, Buffer);
-  ReturnUnlock (SavedTpl, Status);
+  RxqState->CoalStart = 0;
+  RxqState->Polls++;
+  RxqState->Packets += Received;
+  RxqState->PendingCount = Received;
+
+  return Received;
+}
+
+/* Report all processed descriptors to HW with a single status update */
+STATIC
+VOID
+Pp2DxeRxqStatusFlush (
+  IN PP2DXE_CONTEXT *Pp2Context
+  )
+{
+  PP2DXE_PORT *Port = &Pp2Context->Port;
+  PP2DXE_RXQ_STATE *RxqState = &Pp2Context->RxqState;
+  INT32 Processed = RxqState->ProcessedCount;
+
+  if (Processed != 0) {
+    /* Buffers are refilled by HW from BM pool, so free all used descriptors */
+    Mvpp2RxqStatusUpdate(Port, Port->Rxqs[0].Id, Processed, Processed);
+    RxqState->ProcessedCount = 0;
+  }
+}
+
+/* Fetch next received descriptor and account it as processed */
+STATIC
+MVPP2_RX_DESC *
+Pp2DxeRxqDescGet (
+  IN PP2DXE_CONTEXT *Pp2Context
+  )
+{
+  PP2DXE_RXQ_STATE *RxqState = &Pp2Context->RxqState;
+
+  ASSERT (RxqState->PendingCount > 0);
+
+  RxqState->PendingCount--;
+  RxqState->ProcessedCount++;
+  RxqState->Consumed++;
+
+  return Mvpp2RxqNextDescGet(&Pp2Context->Port.Rxqs[0]);
 }
 
 EFI_STATUS
@@ -1004,10 +1452,10 @@ Pp2SnpReceive (
   OUT UINT16                     *EtherType OPTIONAL
   )
 {
-  INTN ReceivedPackets;
   PP2DXE_CONTEXT *Pp2Context = INSTANCE_FROM_SNP(This);
   PP2DXE_PORT *Port = &Pp2Context->Port;
   MVPP2_SHARED *Mvpp2Shared = Pp2Context->Port.Priv;
+  PP2DXE_RXQ_STATE *RxqState = &Pp2Context->RxqState;
   UINTN PhysAddr, VirtAddr;
   EFI_STATUS Status = EFI_SUCCESS;
   EFI_TPL SavedTpl;
@@ -1022,14 +1470,13 @@ Pp2SnpReceive (
   ASSERT (Rxq != NULL);
 
   SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
-  ReceivedPackets = Mvpp2RxqReceived(Port, Rxq->Id);
 
-  if (ReceivedPackets == 0) {
+  if (Pp2DxeRxqPendingGet(Pp2Context) == 0) {
     ReturnUnlock(SavedTpl, EFI_NOT_READY);
   }
 
-  /* Process one packet per call */
-  RxDesc = Mvpp2RxqNextDescGet(Rxq);
+  /* Peek the descriptor, it is consumed only if the frame fits in Buffer */
+  RxDesc = Rxq->Descs + Rxq->NextDescToProc;
   StatusReg = RxDesc->status;
 
   /* extract addresses from descriptor */
@@ -1039,6 +1486,7 @@ Pp2SnpReceive (
   /* Drop packets with error or with buffer header (MC, SG) */
   if ((StatusReg & MVPP2_RXD_BUF_HDR) || (StatusReg & MVPP2_RXD_ERR_SUMMARY)) {
     DEBUG((DEBUG_WARN, "Pp2Dxe: dropping packet\n"));
+    RxqState->Dropped++;
     Status = EFI_DEVICE_ERROR;
     goto drop;
   }
@@ -1077,16 +1525,423 @@ Pp2SnpReceive (
   }
 
 drop:
+  Pp2DxeRxqDescGet(Pp2Context);
+  if (RxqState->PendingCount == 0) {
+    Pp2DxeRxqStatusFlush(Pp2Context);
+  }
+
   /* Refill: pass packet back to BM */
   PoolId = (StatusReg & MVPP2_RXD_BM_POOL_ID_MASK) >> MVPP2_RXD_BM_POOL_ID_OFFS;
-  Mvpp2BmPoolPut(Mvpp2Shared, PoolId, PhysAddr, VirtAddr);
+  Pp2DxeBmPoolPut(Mvpp2Shared, PoolId, PhysAddr, VirtAddr);
+
+  ReturnUnlock(SavedTpl, Status);
+}
+
+/* Loans of the port, which may be released from any processor */
+STATIC
+PP2DXE_RX_LOAN *
+Pp2DxeRxLoanGet (
+  IN PP2DXE_CONTEXT *Pp2Context
+  )
+{
+  PP2DXE_RX_LOAN *RxLoan = NULL;
+  BOOLEAN InterruptState;
+  INTN Index;
+
+  InterruptState = Pp2DxeLock (&Pp2Context->RxLoanLock);
+
+  for (Index = 0; Index < PP2DXE_MAX_RX_LOANS; Index++) {
+    if (!Pp2Context->RxLoans[Index].InUse) {
+      RxLoan = &Pp2Context->RxLoans[Index];
+      RxLoan->InUse = TRUE;
+      break;
+    }
+  }
+
+  Pp2DxeUnlock (&Pp2Context->RxLoanLock, InterruptState);
+
+  return RxLoan;
+}
+
+STATIC
+VOID
+Pp2DxeRxLoanPut (
+  IN PP2DXE_RX_LOAN *RxLoan
+  )
+{
+  PP2DXE_CONTEXT *Pp2Context = RxLoan->Pp2Context;
+  BOOLEAN InterruptState;
+
+  InterruptState = Pp2DxeLock (&Pp2Context->RxLoanLock);
+  ASSERT (RxLoan->InUse);
+  RxLoan->InUse = FALSE;
+  Pp2DxeUnlock (&Pp2Context->RxLoanLock, InterruptState);
+}
+
+STATIC
+EFI_STATUS
+EFIAPI
+Pp2NetRxBufferRelease (
+  IN MARVELL_PP2_RX_BUFFER *RxBuffer
+  )
+{
+  PP2DXE_RX_LOAN *RxLoan;
+  PP2DXE_CONTEXT *Pp2Context;
+  BOOLEAN InterruptState;
 
-  /* Update counters with 1 packet received and 1 packet refilled */
-  Mvpp2RxqStatusUpdate(Port, Rxq->Id, 1, 1);
+  RxLoan = BASE_CR (RxBuffer, PP2DXE_RX_LOAN, RxBuffer);
+  Pp2Context = RxLoan->Pp2Context;
+
+  /* BM must not be touched while the port is down, keep the buffer aside */
+  if (Pp2Context->Snp.Mode->State != EfiSimpleNetworkInitialized) {
+    InterruptState = Pp2DxeLock (&Pp2Context->RxLoanLock);
+    RxLoan->Parked = TRUE;
+    Pp2DxeUnlock (&Pp2Context->RxLoanLock, InterruptState);
+    return EFI_NOT_STARTED;
+  }
+
+  /* Refill: pass buffer back to BM */
+  Pp2DxeBmPoolPut(Pp2Context->Port.Priv, RxLoan->PoolId, RxLoan->PhysAddr, RxLoan->VirtAddr);
+  Pp2DxeRxLoanPut (RxLoan);
+
+  return EFI_SUCCESS;
+}
+
+/*
+ * Lend up to Count received frames.
+ * Caller must be running at TPL_CALLBACK.
+ */
+STATIC
+EFI_STATUS
+Pp2DxeRxqBurst (
+  IN PP2DXE_CONTEXT *Pp2Context,
+  OUT MARVELL_PP2_RX_BUFFER **RxBuffers,
+  IN OUT UINTN *Count
+  )
+{
+  MVPP2_SHARED *Mvpp2Shared = Pp2Context->Port.Priv;
+  PP2DXE_RXQ_STATE *RxqState = &Pp2Context->RxqState;
+  MVPP2_RX_DESC *RxDesc;
+  PP2DXE_RX_LOAN *RxLoan = NULL;
+  UINTN PhysAddr, VirtAddr;
+  UINT32 StatusReg;
+  INTN PoolId;
+  UINTN Received;
+
+  Received = 0;
+  while (Received < *Count && Pp2DxeRxqPendingGet(Pp2Context) != 0) {
+    RxLoan = Pp2DxeRxLoanGet (Pp2Context);
+    if (RxLoan == NULL) {
+      RxqState->LoanFailures++;
+      break;
+    }
+
+    RxDesc = Pp2DxeRxqDescGet(Pp2Context);
+    StatusReg = RxDesc->status;
+    PhysAddr = RxDesc->BufPhysAddrKeyHash & MVPP22_ADDR_MASK;
+    VirtAddr = RxDesc->BufCookieBmQsetClsInfo & MVPP22_ADDR_MASK;
+    PoolId = (StatusReg & MVPP2_RXD_BM_POOL_ID_MASK) >> MVPP2_RXD_BM_POOL_ID_OFFS;
+
+    RxLoan->Pp2Context = Pp2Context;
+
+    /* Drop packets with error or with buffer header (MC, SG) */
+    if ((StatusReg & MVPP2_RXD_BUF_HDR) || (StatusReg & MVPP2_RXD_ERR_SUMMARY)) {
+      RxqState->Dropped++;
+      Pp2DxeBmPoolPut(Mvpp2Shared, PoolId, PhysAddr, VirtAddr);
+      Pp2DxeRxLoanPut (RxLoan);
+      continue;
+    }
+
+    RxLoan->PhysAddr = PhysAddr;
+    RxLoan->VirtAddr = VirtAddr;
+    RxLoan->PoolId = PoolId;
+
+    /* Skip 2 bytes of Marvell header */
+    RxLoan->RxBuffer.Packet = (VOID *)(PhysAddr + 2);
+    RxLoan->RxBuffer.PacketSize = (UINTN) RxDesc->DataSize - 2;
+    RxLoan->RxBuffer.Release = Pp2NetRxBufferRelease;
+
+    RxBuffers[Received++] = &RxLoan->RxBuffer;
+  }
+
+  /*
+   * Report the whole burst to HW at once. Descriptors are recycled right
+   * away, as buffers are tracked by the loans from now on.
+   */
+  Pp2DxeRxqStatusFlush(Pp2Context);
+
+  *Count = Received;
+
+  if (Received == 0) {
+    return (RxLoan == NULL) ? EFI_OUT_OF_RESOURCES : EFI_NOT_READY;
+  }
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+Pp2NetReceiveBurst (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  OUT MARVELL_PP2_RX_BUFFER      **RxBuffers,
+  IN OUT UINTN                   *Count
+  )
+{
+  PP2DXE_CONTEXT *Pp2Context = INSTANCE_FROM_PP2_NET(This);
+  EFI_STATUS Status;
+  EFI_TPL SavedTpl;
+
+  if (RxBuffers == NULL || Count == NULL || *Count == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  if (Pp2Context->Snp.Mode->State != EfiSimpleNetworkInitialized) {
+    ReturnUnlock(SavedTpl, EFI_NOT_STARTED);
+  }
+
+  Status = Pp2DxeRxqBurst (Pp2Context, RxBuffers, Count);
 
   ReturnUnlock(SavedTpl, Status);
 }
 
+EFI_STATUS
+EFIAPI
+Pp2NetReceiveZeroCopy (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  OUT MARVELL_PP2_RX_BUFFER      **RxBuffer
+  )
+{
+  UINTN Count = 1;
+
+  return Pp2NetReceiveBurst (This, RxBuffer, &Count);
+}
+
+EFI_STATUS
+EFIAPI
+Pp2NetGetQueueCount (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  OUT UINTN                      *RxQueueCount,
+  OUT UINTN                      *TxQueueCount
+  )
+{
+  if (RxQueueCount == NULL || TxQueueCount == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  *RxQueueCount = RxqNumber;
+  *TxQueueCount = TxqNumber;
+
+  return EFI_SUCCESS;
+}
+
+/*
+ * Per-queue TX routines do not use boot services,
+ * so that they can be called from any processor.
+ */
+EFI_STATUS
+EFIAPI
+Pp2NetTransmitQueue (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  IN UINTN                       TxQueue,
+  IN VOID                        *Buffer,
+  IN UINTN                       BufferSize
+  )
+{
+  PP2DXE_CONTEXT *Pp2Context = INSTANCE_FROM_PP2_NET(This);
+
+  if (TxQueue >= TxqNumber || Buffer == NULL || BufferSize == 0) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (Pp2Context->Snp.Mode->State != EfiSimpleNetworkInitialized) {
+    return EFI_NOT_STARTED;
+  }
+
+  if (!Pp2Context->Snp.Mode->MediaPresent) {
+    return EFI_NOT_READY;
+  }
+
+  return Pp2DxeTxqSend (Pp2Context, TxQueue, Buffer, BufferSize);
+}
+
+EFI_STATUS
+EFIAPI
+Pp2NetRecycleQueue (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  IN UINTN                       TxQueue,
+  OUT VOID                       **Buffer
+  )
+{
+  PP2DXE_CONTEXT *Pp2Context = INSTANCE_FROM_PP2_NET(This);
+
+  if (TxQueue >= TxqNumber || Buffer == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (Pp2Context->Snp.Mode->State != EfiSimpleNetworkInitialized) {
+    return EFI_NOT_STARTED;
+  }
+
+  *Buffer = Pp2DxeTxqRecycle (Pp2Context, TxQueue);
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+Pp2NetSetRxCoalescing (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  IN UINTN                       RxQueue,
+  IN UINT32                      Packets,
+  IN UINT32                      Usec
+  )
+{
+  PP2DXE_CONTEXT *Pp2Context = INSTANCE_FROM_PP2_NET(This);
+  PP2DXE_PORT *Port = &Pp2Context->Port;
+  MVPP2_SHARED *Mvpp2Shared = Port->Priv;
+  PP2DXE_RXQ_STATE *RxqState = &Pp2Context->RxqState;
+  MVPP2_RX_QUEUE *Rxq;
+  BOOLEAN InterruptState;
+  EFI_TPL SavedTpl;
+
+  if (RxQueue >= RxqNumber || Packets > MVPP2_OCCUPIED_THRESH_MASK) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  /* Queues are allocated upon SNP initialization */
+  if (!Pp2Context->LateInitialized) {
+    ReturnUnlock(SavedTpl, EFI_NOT_STARTED);
+  }
+
+  Rxq = &Port->Rxqs[RxQueue];
+
+  /* Keep HW thresholds in line, RXQ registers are accessed indirectly */
+  InterruptState = Pp2DxeLock (&Mvpp2Shared->Lock);
+  Mvpp2RxPktsCoalSet(Port, Rxq, Packets);
+  Mvpp2RxTimeCoalSet(Port, Rxq, Usec);
+  Pp2DxeUnlock (&Mvpp2Shared->Lock, InterruptState);
+
+  RxqState->CoalStart = 0;
+  RxqState->Polls = 0;
+  RxqState->Packets = 0;
+
+  ReturnUnlock(SavedTpl, EFI_SUCCESS);
+}
+
+EFI_STATUS
+EFIAPI
+Pp2NetGetRxCoalescing (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  IN UINTN                       RxQueue,
+  OUT MARVELL_PP2_RX_COALESCING  *Coalescing
+  )
+{
+  PP2DXE_CONTEXT *Pp2Context = INSTANCE_FROM_PP2_NET(This);
+  PP2DXE_RXQ_STATE *RxqState = &Pp2Context->RxqState;
+  MVPP2_RX_QUEUE *Rxq;
+  EFI_TPL SavedTpl;
+
+  if (RxQueue >= RxqNumber || Coalescing == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  if (!Pp2Context->LateInitialized) {
+    ReturnUnlock(SavedTpl, EFI_NOT_STARTED);
+  }
+
+  Rxq = &Pp2Context->Port.Rxqs[RxQueue];
+
+  Coalescing->Packets = Rxq->PktsCoal;
+  Coalescing->Usec = Rxq->TimeCoal;
+  Coalescing->Polls = RxqState->Polls;
+  Coalescing->PolledPackets = RxqState->Packets;
+
+  ReturnUnlock(SavedTpl, EFI_SUCCESS);
+}
+
+EFI_STATUS
+EFIAPI
+Pp2NetSetChecksumOffload (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  IN BOOLEAN                     Enable
+  )
+{
+  PP2DXE_CONTEXT *Pp2Context = INSTANCE_FROM_PP2_NET(This);
+
+  Pp2Context->ChecksumOffload = Enable;
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+Pp2NetGetQueueStatistics (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  IN UINTN                       Queue,
+  OUT MARVELL_PP2_QUEUE_STATISTICS *Statistics
+  )
+{
+  PP2DXE_CONTEXT *Pp2Context = INSTANCE_FROM_PP2_NET(This);
+  PP2DXE_RXQ_STATE *RxqState = &Pp2Context->RxqState;
+  PP2DXE_TXQ_STATE *TxqState;
+  BOOLEAN InterruptState;
+  EFI_TPL SavedTpl;
+
+  if ((Queue >= RxqNumber && Queue >= TxqNumber) || Statistics == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  ZeroMem (Statistics, sizeof (*Statistics));
+
+  if (Queue < RxqNumber) {
+    SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
+    Statistics->RxDescConsumed = RxqState->Consumed;
+    Statistics->RxDropped = RxqState->Dropped;
+    Statistics->RxLoanFailures = RxqState->LoanFailures;
+    gBS->RestoreTPL (SavedTpl);
+  }
+
+  if (Queue < TxqNumber) {
+    TxqState = &Pp2Context->TxqState[Queue];
+    InterruptState = Pp2DxeLock (&TxqState->Lock);
+    Statistics->TxDescQueued = TxqState->Queued;
+    Statistics->TxQueueFull = TxqState->QueueFull;
+    Pp2DxeUnlock (&TxqState->Lock, InterruptState);
+  }
+
+  return EFI_SUCCESS;
+}
+
+/*
+ * WaitForPacket notification function. It runs whenever the event is waited
+ * on or checked, and signals the event if frames are pending on the RXQ used
+ * by SNP. Running at TPL_CALLBACK keeps it serialized with the SNP functions.
+ */
+STATIC
+VOID
+EFIAPI
+Pp2DxeWaitForPacketNotify (
+  IN EFI_EVENT Event,
+  IN VOID *Context
+  )
+{
+  PP2DXE_CONTEXT *Pp2Context = Context;
+
+  if (Pp2Context->Snp.Mode->State != EfiSimpleNetworkInitialized) {
+    return;
+  }
+
+  if (Pp2DxeRxqPendingGet(Pp2Context) != 0) {
+    gBS->SignalEvent (Event);
+  }
+}
+
 EFI_STATUS
 Pp2DxeSnpInstall (
   IN PP2DXE_CONTEXT *Pp2Context
@@ -1104,7 +1959,8 @@ Pp2DxeSnpInstall (
 
   SnpMode = AllocateZeroPool (sizeof (EFI_SIMPLE_NETWORK_MODE));
   if (SnpMode == NULL) {
-    return EFI_OUT_OF_RESOURCES;
+    Status = EFI_OUT_OF_RESOURCES;
+    goto FreeDevicePath;
   }
 
   /* Copy SNP data from templates */
@@ -1125,18 +1981,54 @@ Pp2DxeSnpInstall (
 
   Pp2Context->Snp.Mode = SnpMode;
 
+  Status = gBS->CreateEvent (
+                  EVT_NOTIFY_WAIT,
+                  TPL_CALLBACK,
+                  Pp2DxeWaitForPacketNotify,
+                  Pp2Context,
+                  &Pp2Context->Snp.WaitForPacket
+                  );
+  if (EFI_ERROR(Status)) {
+    DEBUG((DEBUG_ERROR, "Failed to create WaitForPacket event.\n"));
+    goto FreeSnpMode;
+  }
+
+  /* Driver-private extensions of SNP */
+  Pp2Context->Pp2Net.ReceiveZeroCopy = Pp2NetReceiveZeroCopy;
+  Pp2Context->Pp2Net.ReceiveBurst = Pp2NetReceiveBurst;
+  Pp2Context->Pp2Net.GetQueueCount = Pp2NetGetQueueCount;
+  Pp2Context->Pp2Net.TransmitQueue = Pp2NetTransmitQueue;
+  Pp2Context->Pp2Net.RecycleQueue = Pp2NetRecycleQueue;
+  Pp2Context->Pp2Net.SetRxCoalescing = Pp2NetSetRxCoalescing;
+  Pp2Context->Pp2Net.GetRxCoalescing = Pp2NetGetRxCoalescing;
+  Pp2Context->Pp2Net.SetChecksumOffload = Pp2NetSetChecksumOffload;
+  Pp2Context->Pp2Net.GetQueueStatistics = Pp2NetGetQueueStatistics;
+
   /* Install protocol */
   Status = gBS->InstallMultipleProtocolInterfaces (
       &Handle,
       &gEfiSimpleNetworkProtocolGuid, &Pp2Context->Snp,
+      &gMarvellPp2NetProtocolGuid, &Pp2Context->Pp2Net,
       &gEfiDevicePathProtocolGuid, Pp2DevicePath,
       NULL
       );
 
   if (EFI_ERROR(Status)) {
     DEBUG((DEBUG_ERROR, "Failed to install protocols.\n"));
+    goto CloseEvent;
   }
 
+  return EFI_SUCCESS;
+
+CloseEvent:
+  gBS->CloseEvent (Pp2Context->Snp.WaitForPacket);
+  Pp2Context->Snp.WaitForPacket = NULL;
+FreeSnpMode:
+  Pp2Context->Snp.Mode = NULL;
+  FreePool (SnpMode);
+FreeDevicePath:
+  Pp2Context->DevicePath = NULL;
+  FreePool (Pp2DevicePath);
   return Status;
 }
 
@@ -1182,6 +2074,7 @@ Pp2DxeInitialiseController (
   PP2DXE_CONTEXT *Pp2Context = NULL;
   EFI_STATUS Status;
   INTN Index;
+  INTN Queue;
   INTN PortIndex = 0;
   VOID *BufferSpace;
   UINT32 NetCompConfig = 0;
@@ -1194,6 +2087,7 @@ Pp2DxeInitialiseController (
   Mvpp2Shared->MpcsBase = Mvpp2Shared->Base + MVPP22_MPCS_OFFSET;
   Mvpp2Shared->SmiBase = Mvpp2Shared->Base + MVPP22_SMI_OFFSET;
   Mvpp2Shared->Tclk = ClockFrequency;
+  InitializeSpinLock (&Mvpp2Shared->Lock);
 
   /* Prepare buffers */
   Status = DmaAllocateAlignedBuffer (EfiBootServicesData,
@@ -1209,21 +2103,21 @@ Pp2DxeInitialiseController (
 
   for (Index = 0; Index < MVPP2_MAX_PORT; Index++) {
     Mvpp2Shared->BufferLocation.TxDescs[Index] = (MVPP2_TX_DESC *)
-      (BufferSpace + Index * MVPP2_MAX_TXD * sizeof(MVPP2_TX_DESC));
+      (BufferSpace + Index * MVPP2_PORT_TXD * sizeof(MVPP2_TX_DESC));
   }
 
   Mvpp2Shared->BufferLocation.AggrTxDescs = (MVPP2_TX_DESC *)
-    ((UINTN)BufferSpace + MVPP2_MAX_TXD * MVPP2_MAX_PORT * sizeof(MVPP2_TX_DESC));
+    ((UINTN)BufferSpace + MVPP2_PORT_TXD * MVPP2_MAX_PORT * sizeof(MVPP2_TX_DESC));
 
   for (Index = 0; Index < MVPP2_MAX_PORT; Index++) {
     Mvpp2Shared->BufferLocation.RxDescs[Index] = (MVPP2_RX_DESC *)
-      ((UINTN)BufferSpace + (MVPP2_MAX_TXD * MVPP2_MAX_PORT + MVPP2_AGGR_TXQ_SIZE) *
+      ((UINTN)BufferSpace + (MVPP2_PORT_TXD * MVPP2_MAX_PORT + MVPP2_AGGR_TXQ_SIZE) *
       sizeof(MVPP2_TX_DESC) + Index * MVPP2_MAX_RXD * sizeof(MVPP2_RX_DESC));
   }
 
   for (Index = 0; Index < MVPP2_MAX_PORT; Index++) {
     Mvpp2Shared->BufferLocation.RxBuffers[Index] = (DmaAddrT)
-      (BufferSpace + (MVPP2_MAX_TXD * MVPP2_MAX_PORT + MVPP2_AGGR_TXQ_SIZE) *
+      (BufferSpace + (MVPP2_PORT_TXD * MVPP2_MAX_PORT + MVPP2_AGGR_TXQ_SIZE) *
       sizeof(MVPP2_TX_DESC) + MVPP2_MAX_RXD * MVPP2_MAX_PORT * sizeof(MVPP2_RX_DESC) +
       Index * MVPP2_BM_SIZE * RX_BUFFER_SIZE);
   }
@@ -1291,6 +2185,11 @@ Pp2DxeInitialiseController (
     Pp2Context->Instance = DeviceInstance;
     DeviceInstance++;
 
+    for (Queue = 0; Queue < MVPP2_MAX_TXQ; Queue++) {
+      InitializeSpinLock (&Pp2Context->TxqState[Queue].Lock);
+    }
+    InitializeSpinLock (&Pp2Context->RxLoanLock);
+
     /* Install SNP protocol */
     Status = Pp2DxeSnpInstall(Pp2Context);
     if (EFI_ERROR(Status)) {
@@ -1305,6 +2204,8 @@ Pp2DxeInitialiseController (
                                 MVPP22_GMAC_REG_SIZE * Pp2Context->Port.GopIndex;
     Pp2Context->Port.XlgBase = Mvpp2Shared->Base + MVPP22_XLG_OFFSET +
                                MVPP22_XLG_REG_SIZE * Pp2Context->Port.GopIndex;
+    Pp2Context->Port.MibBase = Mvpp2Shared->Base + MVPP22_MIB_OFFSET +
+                               MVPP22_MIB_REG_SIZE * Pp2Context->Port.GopIndex;
 
     /* Gather accumulated configuration data of all ports' MAC's */
     NetCompConfig |= MvpPp2xGop110NetcCfgCreate(&Pp2Context->Port);
@@ -1365,6 +2266,12 @@ Pp2DxeInitialise (
     return EFI_INVALID_PARAMETER;
   }
 
+  /* Check amount of queues used by each port */
+  if (TxqNumber <= 0 || TxqNumber > MVPP2_MAX_TXQ) {
+    DEBUG ((DEBUG_ERROR, "Pp2Dxe: Wrong number of queues per port\n"));
+    return EFI_INVALID_PARAMETER;
+  }
+
   /* Initialize enabled chips */
   for (Index = 0; Index < PcdGetSize (PcdPp2Controllers); Index++) {
     if (!MVHW_DEV_ENABLED (Pp2, Index)) {
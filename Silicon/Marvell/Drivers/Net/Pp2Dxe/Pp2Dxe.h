@@ -41,6 +41,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <Protocol/Ip4.h>
 #include <Protocol/Ip6.h>
 #include <Protocol/MvPhy.h>
+#include <Protocol/Pp2Net.h>
 #include <Protocol/SimpleNetwork.h>
 
 #include <Library/BaseLib.h>
@@ -51,6 +52,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <Library/MemoryAllocationLib.h>
 #include <Library/NetLib.h>
 #include <Library/PcdLib.h>
+#include <Library/SynchronizationLib.h>
+#include <Library/TimerLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiLib.h>
 
@@ -58,8 +61,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define MVPP2_MAX_PORT  3
 
+/* Descriptors preallocated for all TXQs of a single Port */
+#define MVPP2_PORT_TXD  (MVPP2_MAX_TXD * MVPP2_MAX_TXQ)
+
 #define PP2DXE_SIGNATURE                    SIGNATURE_32('P', 'P', '2', 'D')
 #define INSTANCE_FROM_SNP(a)                CR((a), PP2DXE_CONTEXT, Snp, PP2DXE_SIGNATURE)
+#define INSTANCE_FROM_PP2_NET(a)            CR((a), PP2DXE_CONTEXT, Pp2Net, PP2DXE_SIGNATURE)
 
 /* OS API */
 #define Mvpp2Alloc(v)                       AllocateZeroPool(v)
@@ -113,6 +120,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MV_PPP_IPV6                         13
 #define MV_ETH_ALEN                         NET_ETHER_ADDR_LEN
 
+/*
+ * Frame layout used for checksum offload. Unlike the protocol macros above,
+ * which encode parser entries, these are the values found on the wire.
+ */
+#define MV_ETH_TYPE_IP4                     0x0800
+#define MV_ETH_TYPE_IP6                     0x86DD
+#define MV_ETH_TYPE_VLAN                    0x8100
+#define MV_IP_PROTO_TCP                     6
+#define MV_IP_PROTO_UDP                     17
+#define MV_ETH_HLEN                         14
+#define MV_VLAN_HLEN                        4
+#define MV_IP4_MIN_HLEN                     20
+#define MV_IP6_HLEN                         40
+#define MV_IP4_FRAG_MASK                    0x3fff
+
 /* PHY modes */
 #define MV_MODE_SGMII                       PHY_CONNECTION_SGMII
 #define MV_MODE_RGMII                       PHY_CONNECTION_RGMII
@@ -167,12 +189,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define WRAP                              (2 + ETH_HLEN + 4 + 32)
 #define MTU                               1500
 
-/*
- * Maximum retries of checking, wheter HW really sent the packet
- * after it was done is software.
- */
-#define MVPP2_TX_SEND_MAX_POLLING_COUNT   10000
-
 /* Structures */
 typedef struct {
   /* Physical number of this Tx queue */
@@ -298,6 +314,9 @@ typedef struct {
 
   /* Tclk value */
   UINT32 Tclk;
+
+  /* Serializes access to aggregated TXQ, BM and indirect queue registers */
+  SPIN_LOCK Lock;
 } MVPP2_SHARED;
 
 /* Individual Port structure */
@@ -312,6 +331,7 @@ struct Pp2DxePort {
   /* Per-Port registers' base address */
   UINT64 GmacBase;
   UINT64 XlgBase;
+  UINT64 MibBase;
 
   MVPP2_RX_QUEUE *Rxqs;
   MVPP2_TX_QUEUE *Txqs;
@@ -347,24 +367,98 @@ typedef struct {
   EFI_DEVICE_PATH_PROTOCOL  End;
 } PP2_DEVICE_PATH;
 
+/*
+ * Maximum number of BM buffers lent to zero-copy receive consumers.
+ * Keep part of the pool available for incoming traffic.
+ */
+#define PP2DXE_MAX_RX_LOANS                (MVPP2_BM_SIZE / 2)
+
+typedef struct Pp2DxeContext PP2DXE_CONTEXT;
+
+typedef struct {
+  MARVELL_PP2_RX_BUFFER       RxBuffer;
+  PP2DXE_CONTEXT              *Pp2Context;
+  UINTN                       PhysAddr;
+  UINTN                       VirtAddr;
+  INT32                       PoolId;
+  BOOLEAN                     InUse;
+  /* Released while the port was down, to be returned to BM later */
+  BOOLEAN                     Parked;
+} PP2DXE_RX_LOAN;
+
 #define QUEUE_DEPTH 64
+
+typedef struct {
+  SPIN_LOCK                   Lock;
+  VOID                        *CompletionQueue[QUEUE_DEPTH];
+  UINTN                       CompletionQueueHead;
+  UINTN                       CompletionQueueSent;
+  UINTN                       CompletionQueueTail;
+  /* Descriptors queued to the HW and frames rejected because the queue was full */
+  UINT64                      Queued;
+  UINT64                      QueueFull;
+} PP2DXE_TXQ_STATE;
+
+/* State of the RXQ, serialized with TPL_CALLBACK as it is used by SNP */
+typedef struct {
+  INT32                       PendingCount;
+  INT32                       ProcessedCount;
+  /* Arrival time of the oldest frame held back by coalescing, in ns */
+  UINT64                      CoalStart;
+  UINT64                      Polls;
+  UINT64                      Packets;
+  /* Descriptors consumed, frames dropped and loans that could not be made */
+  UINT64                      Consumed;
+  UINT64                      Dropped;
+  UINT64                      LoanFailures;
+} PP2DXE_RXQ_STATE;
+
+/* MIB counters of the port accumulated since the last statistics reset */
 typedef struct {
+  UINT64                      GoodOctetsRcvd;
+  UINT64                      BadOctetsRcvd;
+  UINT64                      UnicastFramesRcvd;
+  UINT64                      BroadcastFramesRcvd;
+  UINT64                      MulticastFramesRcvd;
+  UINT64                      GoodOctetsSent;
+  UINT64                      UnicastFramesSent;
+  UINT64                      MulticastFramesSent;
+  UINT64                      BroadcastFramesSent;
+  UINT64                      CrcErrorsSent;
+  UINT64                      RxFifoOverrun;
+  UINT64                      UndersizeRcvd;
+  UINT64                      FragmentsRcvd;
+  UINT64                      OversizeRcvd;
+  UINT64                      JabberRcvd;
+  UINT64                      MacRecError;
+  UINT64                      BadCrcEvent;
+  UINT64                      Collision;
+  UINT64                      LateCollision;
+} PP2DXE_MIB_COUNTERS;
+
+struct Pp2DxeContext {
   UINT32                      Signature;
   INTN                        Instance;
   EFI_HANDLE                  Controller;
   EFI_LOCK                    Lock;
   EFI_SIMPLE_NETWORK_PROTOCOL Snp;
+  MARVELL_PP2_NET_PROTOCOL    Pp2Net;
   MARVELL_PHY_PROTOCOL        *Phy;
   PHY_DEVICE                  *PhyDev;
   PP2DXE_PORT                 Port;
   BOOLEAN                     Initialized;
   BOOLEAN                     LateInitialized;
-  VOID                        *CompletionQueue[QUEUE_DEPTH];
-  UINTN                       CompletionQueueHead;
-  UINTN                       CompletionQueueTail;
+  BOOLEAN                     ChecksumOffload;
+  PP2DXE_TXQ_STATE            TxqState[MVPP2_MAX_TXQ];
+  PP2DXE_RXQ_STATE            RxqState;
+  PP2DXE_MIB_COUNTERS         Mib;
+  /* Software drop count at the last statistics reset */
+  UINT64                      RxDroppedAtReset;
   EFI_EVENT                   EfiExitBootServicesEvent;
   PP2_DEVICE_PATH             *DevicePath;
-} PP2DXE_CONTEXT;
+  SPIN_LOCK                   RxLoanLock;
+  PP2DXE_RX_LOAN              RxLoans[PP2DXE_MAX_RX_LOANS];
+};
 
 /* Inline helpers */
 STATIC
@@ -517,6 +611,18 @@ Mvpp2XlgRead (
   return MmioRead32 (Port->XlgBase + Offset);
 }
 
+STATIC
+inline
+UINT32
+Mvpp2MibRead (
+  IN PP2DXE_PORT *Port,
+  IN UINT32 Offset
+  )
+{
+  ASSERT (Port->MibBase != 0);
+  return MmioRead32 (Port->MibBase + Offset);
+}
+
 /* SNP callbacks */
 EFI_STATUS
 EFIAPI
@@ -619,4 +725,77 @@ Pp2SnpReceive (
   OUT EFI_MAC_ADDRESS            *DstAddr OPTIONAL,
   OUT UINT16                     *EtherType OPTIONAL
   );
+
+/* Pp2Net callbacks */
+EFI_STATUS
+EFIAPI
+Pp2NetReceiveZeroCopy (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  OUT MARVELL_PP2_RX_BUFFER      **RxBuffer
+  );
+
+EFI_STATUS
+EFIAPI
+Pp2NetReceiveBurst (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  OUT MARVELL_PP2_RX_BUFFER      **RxBuffers,
+  IN OUT UINTN                   *Count
+  );
+
+EFI_STATUS
+EFIAPI
+Pp2NetGetQueueCount (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  OUT UINTN                      *RxQueueCount,
+  OUT UINTN                      *TxQueueCount
+  );
+
+EFI_STATUS
+EFIAPI
+Pp2NetTransmitQueue (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  IN UINTN                       TxQueue,
+  IN VOID                        *Buffer,
+  IN UINTN                       BufferSize
+  );
+
+EFI_STATUS
+EFIAPI
+Pp2NetRecycleQueue (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  IN UINTN                       TxQueue,
+  OUT VOID                       **Buffer
+  );
+
+EFI_STATUS
+EFIAPI
+Pp2NetSetRxCoalescing (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  IN UINTN                       RxQueue,
+  IN UINT32                      Packets,
+  IN UINT32                      Usec
+  );
+
+EFI_STATUS
+EFIAPI
+Pp2NetGetRxCoalescing (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  IN UINTN                       RxQueue,
+  OUT MARVELL_PP2_RX_COALESCING  *Coalescing
+  );
+
+EFI_STATUS
+EFIAPI
+Pp2NetSetChecksumOffload (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  IN BOOLEAN                     Enable
+  );
+
+EFI_STATUS
+EFIAPI
+Pp2NetGetQueueStatistics (
+  IN MARVELL_PP2_NET_PROTOCOL    *This,
+  IN UINTN                       Queue,
+  OUT MARVELL_PP2_QUEUE_STATISTICS *Statistics
+  );
 #endif
@@ -0,0 +1,1044 @@
+/*******************************************************************************
+Copyright (C) 2017 Marvell International Ltd.
+
+Marvell BSD License Option
+
+If you received this File from Marvell, you may opt to use, redistribute and/or
+modify this File under the following licensing terms.
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+* Neither the name of Marvell nor the names of its contributors may be
+  used to endorse or promote products derived from this software without
+  specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+#include "SdMmcPciHcDxe.h"
+
+/**
+  Send a command of the EMMC command queue protocol and wait for its response.
+
+  @param[in]  Private       A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in]  Slot          The slot number of the EMMC device.
+  @param[in]  CommandIndex  The index of the command.
+  @param[in]  Argument      The argument of the command.
+  @param[in]  ResponseType  The type of the response of the command.
+  @param[out] Response      The first 32 bits of the response, optional.
+
+  @retval EFI_SUCCESS       The command is done correctly.
+  @retval Others            The command fails.
+
+**/
+STATIC
+EFI_STATUS
+EmmcCmdqSendCommand (
+  IN     SD_MMC_HC_PRIVATE_DATA         *Private,
+  IN     UINT8                          Slot,
+  IN     UINT16                         CommandIndex,
+  IN     UINT32                         Argument,
+  IN     EFI_SD_MMC_RESPONSE_TYPE       ResponseType,
+     OUT UINT32                         *Response OPTIONAL
+  )
+{
+  EFI_SD_MMC_COMMAND_BLOCK              SdMmcCmdBlk;
+  EFI_SD_MMC_STATUS_BLOCK               SdMmcStatusBlk;
+  EFI_SD_MMC_PASS_THRU_COMMAND_PACKET   Packet;
+  SD_MMC_HC_TRB                         *Trb;
+  EFI_STATUS                            Status;
+
+  ZeroMem (&SdMmcCmdBlk, sizeof (SdMmcCmdBlk));
+  ZeroMem (&SdMmcStatusBlk, sizeof (SdMmcStatusBlk));
+  ZeroMem (&Packet, sizeof (Packet));
+
+  Packet.SdMmcCmdBlk    = &SdMmcCmdBlk;
+  Packet.SdMmcStatusBlk = &SdMmcStatusBlk;
+  Packet.Timeout        = SD_MMC_HC_GENERIC_TIMEOUT;
+
+  SdMmcCmdBlk.CommandIndex    = CommandIndex;
+  SdMmcCmdBlk.CommandType     = SdMmcCommandTypeAc;
+  SdMmcCmdBlk.ResponseType    = ResponseType;
+  SdMmcCmdBlk.CommandArgument = Argument;
+
+  //
+  // The command is run right away, it does not go through the async I/O queue.
+  //
+  Trb = SdMmcCreateTrb (Private, Slot, &Packet, NULL);
+  if (Trb == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = SdMmcWaitTrbEnv (Private, Trb);
+  if (!EFI_ERROR (Status)) {
+    Status = SdMmcExecTrb (Private, Trb);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = SdMmcWaitTrbResult (Private, Trb);
+  }
+  SdMmcFreeTrb (Trb);
+
+  if (!EFI_ERROR (Status) && (Response != NULL)) {
+    *Response = SdMmcStatusBlk.Resp0;
+  }
+
+  return Status;
+}
+
+/**
+  Enable or disable the command queue of the EMMC device.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+  @param[in] Enable         TRUE to enable the command queue.
+
+  @retval EFI_SUCCESS       The command queue is switched.
+  @retval Others            The SWITCH command fails.
+
+**/
+STATIC
+EFI_STATUS
+EmmcCmdqSwitch (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot,
+  IN BOOLEAN                            Enable
+  )
+{
+  SD_MMC_HC_CMDQ                        *Cmdq;
+  EFI_STATUS                            Status;
+  UINT32                                Argument;
+  UINT32                                DevStatus;
+
+  Cmdq = &Private->Cmdq[Slot];
+
+  //
+  // Write Byte access to the CMDQ_MODE_EN field of EXT_CSD register.
+  //
+  Argument = (0x03 << 24) | (EMMC_EXT_CSD_CMDQ_MODE_EN << 16) | ((Enable ? 1 : 0) << 8);
+  Status   = EmmcCmdqSendCommand (Private, Slot, EMMC_SWITCH, Argument, SdMmcResponseTypeR1b, NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Status = EmmcCmdqSendCommand (Private, Slot, EMMC_SEND_STATUS, (UINT32)Cmdq->Rca << 16, SdMmcResponseTypeR1, &DevStatus);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  //
+  // Check the switch operation is really successful or not.
+  //
+  if ((DevStatus & BIT7) != 0) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  Cmdq->Enabled = Enable;
+  DEBUG ((DEBUG_VERBOSE, "EmmcCmdqSwitch: command queue %a at slot %d\n", Enable ? "enabled" : "disabled", Slot));
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Get the read or write request the TRB at a position of the async I/O queue
+  is part of, if it can run as a task of the command queue.
+
+  @param[in]  Private       A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in]  Slot          The slot number of the EMMC device.
+  @param[in]  Link          The position of the TRB in the async I/O queue.
+  @param[out] Wait          Set to TRUE if the TRB is a SET_BLOCK_COUNT command
+                            whose request is not queued yet.
+
+  @return The TRB of the read or write request, or NULL.
+
+**/
+STATIC
+SD_MMC_HC_TRB *
+EmmcCmdqGetTask (
+  IN  SD_MMC_HC_PRIVATE_DATA            *Private,
+  IN  UINT8                             Slot,
+  IN  LIST_ENTRY                        *Link,
+  OUT BOOLEAN                           *Wait
+  )
+{
+  SD_MMC_HC_TRB                         *Trb;
+
+  *Wait = FALSE;
+  Trb   = SD_MMC_HC_TRB_FROM_THIS (Link);
+  if ((Trb->Slot != Slot) || Trb->Started || Trb->CmdqTask) {
+    return NULL;
+  }
+
+  if (Trb->Packet->SdMmcCmdBlk->CommandIndex == EMMC_SET_BLOCK_COUNT) {
+    Link = GetNextNode (&Private->Queue, Link);
+    if (IsNull (&Private->Queue, Link)) {
+      *Wait = TRUE;
+      return NULL;
+    }
+    Trb = SD_MMC_HC_TRB_FROM_THIS (Link);
+    if ((Trb->Slot != Slot) || Trb->Started || Trb->CmdqTask) {
+      return NULL;
+    }
+  }
+
+  switch (Trb->Packet->SdMmcCmdBlk->CommandIndex) {
+    case EMMC_READ_SINGLE_BLOCK:
+    case EMMC_READ_MULTIPLE_BLOCK:
+    case EMMC_WRITE_BLOCK:
+    case EMMC_WRITE_MULTIPLE_BLOCK:
+      break;
+    default:
+      return NULL;
+  }
+
+  //
+  // Tasks move their data by ADMA2, in up to 65535 blocks of 512 bytes.
+  //
+  if ((Trb->Mode != SdMmcAdmaMode) ||
+      (Trb->BlockSize != 0x200) ||
+      ((Trb->DataLen % 0x200) != 0) ||
+      ((Trb->DataLen / 0x200) > MAX_UINT16)) {
+    return NULL;
+  }
+
+  return Trb;
+}
+
+/**
+  Find the TRB of a task queued on the device.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+  @param[in] TaskId         The task ID.
+
+  @return The TRB of the task, or NULL.
+
+**/
+STATIC
+SD_MMC_HC_TRB *
+EmmcCmdqFindTask (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot,
+  IN UINT8                              TaskId
+  )
+{
+  LIST_ENTRY                            *Link;
+  SD_MMC_HC_TRB                         *Trb;
+
+  for (Link = GetFirstNode (&Private->Queue);
+       !IsNull (&Private->Queue, Link);
+       Link = GetNextNode (&Private->Queue, Link)) {
+    Trb = SD_MMC_HC_TRB_FROM_THIS (Link);
+    if ((Trb->Slot == Slot) && Trb->CmdqTask && (Trb->CmdqTaskId == TaskId)) {
+      return Trb;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Check whether a TRB is pending for longer than the time out of its packet.
+
+  @param[in] Trb            The pointer to the SD_MMC_HC_TRB instance.
+
+  @retval TRUE              The TRB timed out.
+  @retval FALSE             The TRB may still complete.
+
+**/
+STATIC
+BOOLEAN
+EmmcCmdqTimedOut (
+  IN SD_MMC_HC_TRB                      *Trb
+  )
+{
+  if (Trb->Packet->Timeout == 0) {
+    return FALSE;
+  }
+
+  return SdMmcGetElapsedTime (Trb->StartTick) >= MultU64x32 (Trb->Packet->Timeout, 1000);
+}
+
+/**
+  Find a task queued on the device that timed out.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+
+  @return The TRB of the task, or NULL.
+
+**/
+STATIC
+SD_MMC_HC_TRB *
+EmmcCmdqFindExpired (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  )
+{
+  LIST_ENTRY                            *Link;
+  SD_MMC_HC_TRB                         *Trb;
+
+  for (Link = GetFirstNode (&Private->Queue);
+       !IsNull (&Private->Queue, Link);
+       Link = GetNextNode (&Private->Queue, Link)) {
+    Trb = SD_MMC_HC_TRB_FROM_THIS (Link);
+    if ((Trb->Slot == Slot) && Trb->CmdqTask && EmmcCmdqTimedOut (Trb)) {
+      return Trb;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Check whether the command queue is worth switching on for the requests at
+  the head of the async I/O queue.
+
+  The head must start a request: a READ or WRITE_MULTIPLE_BLOCK whose
+  SET_BLOCK_COUNT already went the legacy way goes the legacy way too. Then
+  at least SD_MMC_HC_CMDQ_MIN_TASKS requests in a row must be able to run as
+  tasks.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+
+  @retval TRUE              The command queue is to be enabled.
+  @retval FALSE             The requests go the legacy way.
+
+**/
+STATIC
+BOOLEAN
+EmmcCmdqWorthEnabling (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  )
+{
+  LIST_ENTRY                            *Link;
+  SD_MMC_HC_TRB                         *Trb;
+  SD_MMC_HC_TRB                         *Task;
+  BOOLEAN                               Wait;
+  UINT32                                Count;
+
+  Link = GetFirstNode (&Private->Queue);
+  if (IsNull (&Private->Queue, Link)) {
+    return FALSE;
+  }
+  Trb = SD_MMC_HC_TRB_FROM_THIS (Link);
+  switch (Trb->Packet->SdMmcCmdBlk->CommandIndex) {
+    case EMMC_SET_BLOCK_COUNT:
+    case EMMC_READ_SINGLE_BLOCK:
+    case EMMC_WRITE_BLOCK:
+      break;
+    default:
+      return FALSE;
+  }
+
+  Count = 0;
+  while (!IsNull (&Private->Queue, Link) && (Count < SD_MMC_HC_CMDQ_MIN_TASKS)) {
+    Task = EmmcCmdqGetTask (Private, Slot, Link, &Wait);
+    if (Task == NULL) {
+      break;
+    }
+    Count++;
+    Link = GetNextNode (&Private->Queue, &Task->TrbList);
+  }
+
+  return (BOOLEAN)(Count >= SD_MMC_HC_CMDQ_MIN_TASKS);
+}
+
+/**
+  Create the TRB of a command of the command queue switch run from the async
+  I/O queue. The TRB is not put in the async I/O queue.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+  @param[in] CommandIndex   The index of the command.
+  @param[in] Argument       The argument of the command.
+  @param[in] ResponseType   The type of the response of the command.
+
+  @retval EFI_SUCCESS       The TRB is created.
+  @retval Others            The TRB cannot be created.
+
+**/
+STATIC
+EFI_STATUS
+EmmcCmdqCreateSwitchTrb (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot,
+  IN UINT16                             CommandIndex,
+  IN UINT32                             Argument,
+  IN EFI_SD_MMC_RESPONSE_TYPE           ResponseType
+  )
+{
+  SD_MMC_HC_CMDQ                        *Cmdq;
+
+  Cmdq = &Private->Cmdq[Slot];
+
+  ZeroMem (&Cmdq->SwitchCmdBlk, sizeof (Cmdq->SwitchCmdBlk));
+  ZeroMem (&Cmdq->SwitchStatusBlk, sizeof (Cmdq->SwitchStatusBlk));
+  ZeroMem (&Cmdq->SwitchPacket, sizeof (Cmdq->SwitchPacket));
+
+  Cmdq->SwitchPacket.SdMmcCmdBlk    = &Cmdq->SwitchCmdBlk;
+  Cmdq->SwitchPacket.SdMmcStatusBlk = &Cmdq->SwitchStatusBlk;
+  Cmdq->SwitchPacket.Timeout        = SD_MMC_HC_GENERIC_TIMEOUT;
+
+  Cmdq->SwitchCmdBlk.CommandIndex    = CommandIndex;
+  Cmdq->SwitchCmdBlk.CommandType     = SdMmcCommandTypeAc;
+  Cmdq->SwitchCmdBlk.ResponseType    = ResponseType;
+  Cmdq->SwitchCmdBlk.CommandArgument = Argument;
+
+  Cmdq->SwitchTrb = SdMmcCreateTrb (Private, Slot, &Cmdq->SwitchPacket, NULL);
+  if (Cmdq->SwitchTrb == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  Cmdq->SwitchTrb->StartTick = GetPerformanceCounter ();
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Advance the switch of the command queue started by EmmcCmdqStartSwitch ().
+
+  The SWITCH command and the SEND_STATUS command checking it are run one
+  after the other, and their completion is polled once per call, so the
+  async I/O queue never waits for the busy signal of the device.
+
+  The caller must be at TPL_NOTIFY.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+
+  @retval EFI_NOT_READY     The switch is in progress.
+  @retval EFI_SUCCESS       The command queue is switched.
+  @retval Others            The switch fails.
+
+**/
+STATIC
+EFI_STATUS
+EmmcCmdqSwitchAsync (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  )
+{
+  SD_MMC_HC_CMDQ                        *Cmdq;
+  SD_MMC_HC_TRB                         *Trb;
+  EFI_STATUS                            Status;
+
+  Cmdq = &Private->Cmdq[Slot];
+  Trb  = Cmdq->SwitchTrb;
+
+  if (!Trb->Started) {
+    Status = SdMmcCheckTrbEnv (Private, Trb);
+    if (!EFI_ERROR (Status)) {
+      Trb->Started = TRUE;
+      Status = SdMmcExecTrb (Private, Trb);
+      if (!EFI_ERROR (Status)) {
+        Status = SdMmcCheckTrbResult (Private, Trb);
+      }
+    }
+  } else {
+    Status = SdMmcCheckTrbResult (Private, Trb);
+  }
+
+  if (Status == EFI_NOT_READY) {
+    if (!EmmcCmdqTimedOut (Trb)) {
+      return EFI_NOT_READY;
+    }
+    Status = EFI_TIMEOUT;
+  }
+
+  SdMmcFreeTrb (Trb);
+  Cmdq->SwitchTrb = NULL;
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (Cmdq->SwitchCmdBlk.CommandIndex == EMMC_SWITCH) {
+    //
+    // Check the switch operation is really successful or not.
+    //
+    Status = EmmcCmdqCreateSwitchTrb (Private, Slot, EMMC_SEND_STATUS, (UINT32)Cmdq->Rca << 16, SdMmcResponseTypeR1);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    return EFI_NOT_READY;
+  }
+
+  if ((Cmdq->SwitchStatusBlk.Resp0 & BIT7) != 0) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  Cmdq->Enabled = Cmdq->SwitchEnable;
+  DEBUG ((DEBUG_VERBOSE, "EmmcCmdqSwitchAsync: command queue %a at slot %d\n", Cmdq->Enabled ? "enabled" : "disabled", Slot));
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Start switching the command queue of the EMMC device from the async I/O
+  queue. The switch is then advanced by EmmcCmdqSwitchAsync ().
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+  @param[in] Enable         TRUE to enable the command queue.
+
+  @retval EFI_SUCCESS       The switch is started.
+  @retval Others            The switch cannot be started.
+
+**/
+STATIC
+EFI_STATUS
+EmmcCmdqStartSwitch (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot,
+  IN BOOLEAN                            Enable
+  )
+{
+  EFI_STATUS                            Status;
+  UINT32                                Argument;
+
+  //
+  // Write Byte access to the CMDQ_MODE_EN field of EXT_CSD register.
+  //
+  Argument = (0x03 << 24) | (EMMC_EXT_CSD_CMDQ_MODE_EN << 16) | ((Enable ? 1 : 0) << 8);
+  Private->Cmdq[Slot].SwitchEnable = Enable;
+
+  Status = EmmcCmdqCreateSwitchTrb (Private, Slot, EMMC_SWITCH, Argument, SdMmcResponseTypeR1b);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Issue the SWITCH right away, its completion is polled on the next passes.
+  //
+  Status = EmmcCmdqSwitchAsync (Private, Slot);
+  if (Status == EFI_NOT_READY) {
+    return EFI_SUCCESS;
+  }
+  return Status;
+}
+
+/**
+  Discard all tasks queued on the device. The requests stay in the async I/O
+  queue and are sent to the device again.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+
+**/
+STATIC
+VOID
+EmmcCmdqDiscard (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  )
+{
+  LIST_ENTRY                            *Link;
+  SD_MMC_HC_TRB                         *Trb;
+  EFI_STATUS                            Status;
+
+  //
+  // TM op-code 1h of CMDQ_TASK_MGMT discards the entire queue.
+  //
+  Status = EmmcCmdqSendCommand (Private, Slot, EMMC_CMDQ_TASK_MGMT, 1, SdMmcResponseTypeR1b, NULL);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "EmmcCmdqDiscard: discarding the queue fails with %r\n", Status));
+  }
+
+  for (Link = GetFirstNode (&Private->Queue);
+       !IsNull (&Private->Queue, Link);
+       Link = GetNextNode (&Private->Queue, Link)) {
+    Trb = SD_MMC_HC_TRB_FROM_THIS (Link);
+    if ((Trb->Slot == Slot) && Trb->CmdqTask && !Trb->Started) {
+      Trb->CmdqTask = FALSE;
+    }
+  }
+  Private->Cmdq[Slot].Busy = 0;
+}
+
+/**
+  Queue a read or write request on the device as a task.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Trb            The pointer to the SD_MMC_HC_TRB instance.
+  @param[in] TaskId         A task ID free on the device.
+
+  @retval EFI_SUCCESS       The task is queued.
+  @retval Others            The device refuses the task.
+
+**/
+STATIC
+EFI_STATUS
+EmmcCmdqQueueTask (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN SD_MMC_HC_TRB                      *Trb,
+  IN UINT8                              TaskId
+  )
+{
+  EFI_STATUS                            Status;
+  UINT32                                Argument;
+
+  //
+  // Reliable Write Request, Data Direction, Task ID and Number of Blocks.
+  //
+  Argument = (UINT32)TaskId << 16 | (Trb->DataLen / 0x200);
+  if (Trb->Read) {
+    Argument |= BIT30;
+  }
+  if (Trb->CmdqReliable) {
+    Argument |= BIT31;
+  }
+  Status = EmmcCmdqSendCommand (Private, Trb->Slot, EMMC_QUEUED_TASK_PARAMS, Argument, SdMmcResponseTypeR1, NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  Argument = Trb->Packet->SdMmcCmdBlk->CommandArgument;
+  Status   = EmmcCmdqSendCommand (Private, Trb->Slot, EMMC_QUEUED_TASK_ADDRESS, Argument, SdMmcResponseTypeR1, NULL);
+  if (EFI_ERROR (Status)) {
+    //
+    // TM op-code 2h discards the half queued task.
+    //
+    EmmcCmdqSendCommand (Private, Trb->Slot, EMMC_CMDQ_TASK_MGMT, ((UINT32)TaskId << 16) | 2, SdMmcResponseTypeR1b, NULL);
+    return Status;
+  }
+
+  if (Trb->StartTick == 0) {
+    Trb->StartTick = GetPerformanceCounter ();
+  }
+  Trb->CmdqTask   = TRUE;
+  Trb->CmdqTaskId = TaskId;
+  Private->Cmdq[Trb->Slot].Busy |= (UINT32)1 << TaskId;
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Check the EMMC command queue support of the device from its EXT_CSD register.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+  @param[in] Rca            The relative device address of the device.
+  @param[in] ExtCsd         The content of the EXT_CSD register.
+
+**/
+VOID
+EmmcCmdqInit (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot,
+  IN UINT16                             Rca,
+  IN EMMC_EXT_CSD                       *ExtCsd
+  )
+{
+  SD_MMC_HC_CMDQ                        *Cmdq;
+  UINT8                                 *Data;
+
+  Cmdq = &Private->Cmdq[Slot];
+  Data = (UINT8 *)ExtCsd;
+
+  ZeroMem (Cmdq, sizeof (SD_MMC_HC_CMDQ));
+  if ((Data[EMMC_EXT_CSD_CMDQ_SUPPORT] & BIT0) == 0) {
+    return;
+  }
+  //
+  // Tasks move their data by ADMA2 only.
+  //
+  if (Private->Capability[Slot].Adma2 == 0) {
+    return;
+  }
+
+  Cmdq->Supported = TRUE;
+  Cmdq->Depth     = (Data[EMMC_EXT_CSD_CMDQ_DEPTH] & 0x1F) + 1;
+  Cmdq->Rca       = Rca;
+
+  DEBUG ((DEBUG_INFO, "EmmcCmdqInit: command queue of depth %d at slot %d\n", Cmdq->Depth, Slot));
+}
+
+/**
+  Disable the EMMC command queue of the device, for the next command to be
+  sent the legacy way. The device queue must be empty.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+
+  @retval EFI_SUCCESS       The command queue is disabled.
+  @retval Others            The SWITCH command fails.
+
+**/
+EFI_STATUS
+EmmcCmdqDisable (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  )
+{
+  EFI_STATUS                            Status;
+
+  //
+  // The device takes no SWITCH while tasks are queued on it, and a switch
+  // run from the async I/O queue owns the command line.
+  //
+  if ((Private->Cmdq[Slot].Busy != 0) || (Private->Cmdq[Slot].SwitchTrb != NULL)) {
+    return EFI_NOT_READY;
+  }
+
+  if (!Private->Cmdq[Slot].Enabled) {
+    return EFI_SUCCESS;
+  }
+
+  Status = EmmcCmdqSwitch (Private, Slot, FALSE);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "EmmcCmdqDisable: disabling the command queue fails with %r\n", Status));
+  }
+
+  return Status;
+}
+
+/**
+  Stop the running task and discard all tasks queued on the EMMC device, for
+  the requests of the async I/O queue to be aborted.
+
+  The caller must be at TPL_NOTIFY.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+
+**/
+VOID
+EmmcCmdqAbort (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  )
+{
+  SD_MMC_HC_CMDQ                        *Cmdq;
+  UINT8                                 SwReset;
+
+  Cmdq = &Private->Cmdq[Slot];
+
+  if (Cmdq->Running || (Cmdq->SwitchTrb != NULL)) {
+    //
+    // Reset the CMD and DAT lines to stop the data transfer or the switch.
+    //
+    SwReset = BIT1 | BIT2;
+    SdMmcHcRwMmio (Private->PciIo, Slot, SD_MMC_HC_SW_RST, FALSE, sizeof (SwReset), &SwReset);
+    SdMmcHcWaitMmioSet (
+      Private->PciIo,
+      Slot,
+      SD_MMC_HC_SW_RST,
+      sizeof (SwReset),
+      0xFF,
+      0x00,
+      SD_MMC_HC_GENERIC_TIMEOUT
+      );
+    Cmdq->Running = FALSE;
+  }
+
+  if (Cmdq->SwitchTrb != NULL) {
+    SdMmcFreeTrb (Cmdq->SwitchTrb);
+    Cmdq->SwitchTrb = NULL;
+    //
+    // The device may have switched, disable the command queue again before
+    // the next legacy command.
+    //
+    Cmdq->Enabled = TRUE;
+  }
+
+  if (Cmdq->Busy != 0) {
+    EmmcCmdqDiscard (Private, Slot);
+  }
+}
+
+/**
+  Forget the EMMC command queue state of a slot whose device is removed.
+
+  The caller must be at TPL_NOTIFY.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+
+**/
+VOID
+EmmcCmdqReset (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  )
+{
+  if (Private->Cmdq[Slot].SwitchTrb != NULL) {
+    SdMmcFreeTrb (Private->Cmdq[Slot].SwitchTrb);
+  }
+  ZeroMem (&Private->Cmdq[Slot], sizeof (SD_MMC_HC_CMDQ));
+}
+
+/**
+  Advance the async I/O queue of a slot through the EMMC command queue.
+
+  Read and write requests at the head of the async I/O queue are sent to the
+  device as tasks, up to the queue depth, and the task the device reports
+  ready is run. Completed requests are removed from the async I/O queue.
+
+  The caller must be at TPL_NOTIFY.
+
+  @param[in]  Private       A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in]  Slot          The slot number of the EMMC device.
+  @param[out] Completed     Set to TRUE if a request is completed.
+
+  @retval EFI_SUCCESS       The async I/O queue is handled by the command queue.
+  @retval EFI_UNSUPPORTED   The request at the head of the async I/O queue is
+                            to be run the legacy way, the command queue is
+                            disabled.
+
+**/
+EFI_STATUS
+EmmcCmdqProcess (
+  IN  SD_MMC_HC_PRIVATE_DATA            *Private,
+  IN  UINT8                             Slot,
+  OUT BOOLEAN                           *Completed
+  )
+{
+  SD_MMC_HC_CMDQ                        *Cmdq;
+  LIST_ENTRY                            *Link;
+  LIST_ENTRY                            *NextLink;
+  SD_MMC_HC_TRB                         *Trb;
+  SD_MMC_HC_TRB                         *Task;
+  EFI_STATUS                            Status;
+  BOOLEAN                               Wait;
+  UINT32                                Ready;
+  UINT32                                Poll;
+  UINT8                                 TaskId;
+
+  Cmdq       = &Private->Cmdq[Slot];
+  Poll       = 0;
+  *Completed = FALSE;
+
+  //
+  // A switch of the command queue goes before anything else.
+  //
+  if (Cmdq->SwitchTrb != NULL) {
+    Status = EmmcCmdqSwitchAsync (Private, Slot);
+    if (Status == EFI_NOT_READY) {
+      return EFI_SUCCESS;
+    }
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "EmmcCmdqProcess: %a the command queue fails with %r\n", Cmdq->SwitchEnable ? "enabling" : "disabling", Status));
+      if (Cmdq->SwitchEnable) {
+        Cmdq->Supported = FALSE;
+        return EFI_UNSUPPORTED;
+      }
+      //
+      // The device may still be in command queue mode, in which it refuses
+      // the legacy request at the head. Fail it, the next one tries again.
+      //
+      Link = GetFirstNode (&Private->Queue);
+      if (!IsNull (&Private->Queue, Link)) {
+        SdMmcCompleteAsyncTrb (SD_MMC_HC_TRB_FROM_THIS (Link), Status);
+        *Completed = TRUE;
+      }
+      return EFI_SUCCESS;
+    }
+  }
+
+  while (TRUE) {
+    //
+    // Wait for the running task to move its data. A task just started is
+    // polled inline for a while if it is short.
+    //
+    if (Cmdq->Running) {
+      Task = EmmcCmdqFindTask (Private, Slot, Cmdq->RunningId);
+      ASSERT (Task != NULL);
+      Status = SdMmcCheckTrbResult (Private, Task);
+      while ((Status == EFI_NOT_READY) && (Poll-- > 0)) {
+        gBS->Stall (1);
+        Status = SdMmcCheckTrbResult (Private, Task);
+      }
+      Poll = 0;
+      if (Status == EFI_NOT_READY) {
+        if (!EmmcCmdqTimedOut (Task)) {
+          return EFI_SUCCESS;
+        }
+        Status = EFI_TIMEOUT;
+      }
+
+      Cmdq->Running = FALSE;
+      Cmdq->Busy   &= ~((UINT32)1 << Task->CmdqTaskId);
+      SdMmcCompleteAsyncTrb (Task, Status);
+      *Completed = TRUE;
+      if (EFI_ERROR (Status)) {
+        EmmcCmdqDiscard (Private, Slot);
+      }
+    }
+
+    //
+    // Send the read and write requests at the head of the async I/O queue to
+    // the device. SET_BLOCK_COUNT commands are folded into the task parameters.
+    //
+    for (Link = GetFirstNode (&Private->Queue);
+         !IsNull (&Private->Queue, Link);
+         Link = NextLink) {
+      NextLink = GetNextNode (&Private->Queue, Link);
+      Trb      = SD_MMC_HC_TRB_FROM_THIS (Link);
+      if (Trb->CmdqTask) {
+        continue;
+      }
+
+      Task = EmmcCmdqGetTask (Private, Slot, Link, &Wait);
+      if (Task == NULL) {
+        //
+        // The request of a SET_BLOCK_COUNT command is queued right after it.
+        //
+        if (Wait) {
+          if (Trb->StartTick == 0) {
+            Trb->StartTick = GetPerformanceCounter ();
+          }
+          if (EmmcCmdqTimedOut (Trb)) {
+            SdMmcCompleteAsyncTrb (Trb, EFI_TIMEOUT);
+            *Completed = TRUE;
+          }
+        }
+        break;
+      }
+
+      for (TaskId = 0; TaskId < Cmdq->Depth; TaskId++) {
+        if ((Cmdq->Busy & ((UINT32)1 << TaskId)) == 0) {
+          break;
+        }
+      }
+      if (TaskId == Cmdq->Depth) {
+        break;
+      }
+
+      if (!Cmdq->Enabled) {
+        if (!EmmcCmdqWorthEnabling (Private, Slot)) {
+          break;
+        }
+        Status = EmmcCmdqStartSwitch (Private, Slot, TRUE);
+        if (EFI_ERROR (Status)) {
+          DEBUG ((DEBUG_ERROR, "EmmcCmdqProcess: enabling the command queue fails with %r\n", Status));
+          Cmdq->Supported = FALSE;
+          return EFI_UNSUPPORTED;
+        }
+        return EFI_SUCCESS;
+      }
+
+      if (Task != Trb) {
+        //
+        // Only the Reliable Write Request of SET_BLOCK_COUNT is kept, the
+        // block count is that of the request.
+        //
+        Task->CmdqReliable = (Trb->Packet->SdMmcCmdBlk->CommandArgument & BIT31) != 0;
+        ZeroMem (Trb->Packet->SdMmcStatusBlk, sizeof (EFI_SD_MMC_STATUS_BLOCK));
+        Trb->Packet->SdMmcStatusBlk->Resp0 = SD_MMC_HC_DEFERRED_CMD23_STATUS;
+        SdMmcCompleteAsyncTrb (Trb, EFI_SUCCESS);
+        *Completed = TRUE;
+        continue;
+      }
+
+      Status = EmmcCmdqQueueTask (Private, Task, TaskId);
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_ERROR, "EmmcCmdqProcess: queueing task %d fails with %r\n", TaskId, Status));
+        SdMmcCompleteAsyncTrb (Task, Status);
+        *Completed = TRUE;
+      }
+    }
+
+    if (Cmdq->Busy == 0) {
+      //
+      // Nothing is queued on the device. Go on the legacy way unless the
+      // async I/O queue is empty or waits for a request, switching the
+      // command queue off first.
+      //
+      Link = GetFirstNode (&Private->Queue);
+      if (IsNull (&Private->Queue, Link)) {
+        return EFI_SUCCESS;
+      }
+      if (!Cmdq->Enabled) {
+        return EFI_UNSUPPORTED;
+      }
+      if ((EmmcCmdqGetTask (Private, Slot, Link, &Wait) != NULL) || Wait) {
+        return EFI_SUCCESS;
+      }
+      Status = EmmcCmdqStartSwitch (Private, Slot, FALSE);
+      if (EFI_ERROR (Status)) {
+        DEBUG ((DEBUG_ERROR, "EmmcCmdqProcess: disabling the command queue fails with %r\n", Status));
+        SdMmcCompleteAsyncTrb (SD_MMC_HC_TRB_FROM_THIS (Link), Status);
+        *Completed = TRUE;
+      }
+      return EFI_SUCCESS;
+    }
+
+    //
+    // Run the first task the device reports ready in its Queue Status Register.
+    //
+    Status = EmmcCmdqSendCommand (
+               Private,
+               Slot,
+               EMMC_SEND_STATUS,
+               ((UINT32)Cmdq->Rca << 16) | BIT15,
+               SdMmcResponseTypeR1,
+               &Ready
+               );
+    if (!EFI_ERROR (Status)) {
+      Ready &= Cmdq->Busy;
+    }
+    if (EFI_ERROR (Status) || (Ready == 0)) {
+      Task = EmmcCmdqFindExpired (Private, Slot);
+      if (EFI_ERROR (Status) || (Task != NULL)) {
+        EmmcCmdqDiscard (Private, Slot);
+      }
+      if (Task == NULL) {
+        return EFI_SUCCESS;
+      }
+      SdMmcCompleteAsyncTrb (Task, EFI_TIMEOUT);
+      *Completed = TRUE;
+      continue;
+    }
+
+    TaskId = (UINT8)LowBitSet32 (Ready);
+    Task   = EmmcCmdqFindTask (Private, Slot, TaskId);
+    ASSERT (Task != NULL);
+
+    Status = SdMmcCheckTrbEnv (Private, Task);
+    if (Status == EFI_NOT_READY) {
+      return EFI_SUCCESS;
+    }
+    if (!EFI_ERROR (Status)) {
+      //
+      // The task runs its data transfer with EXECUTE_READ_TASK or
+      // EXECUTE_WRITE_TASK in place of the command of the request.
+      //
+      Cmdq->TaskCmdBlk                 = Task->Packet->SdMmcCmdBlk;
+      Cmdq->ExecCmdBlk.CommandIndex    = Task->Read ? EMMC_EXECUTE_READ_TASK : EMMC_EXECUTE_WRITE_TASK;
+      Cmdq->ExecCmdBlk.CommandType     = SdMmcCommandTypeAdtc;
+      Cmdq->ExecCmdBlk.ResponseType    = SdMmcResponseTypeR1;
+      Cmdq->ExecCmdBlk.CommandArgument = (UINT32)TaskId << 16;
+      Task->Packet->SdMmcCmdBlk        = &Cmdq->ExecCmdBlk;
+      Task->Started                    = TRUE;
+
+      Status = SdMmcExecTrb (Private, Task);
+    }
+    if (EFI_ERROR (Status)) {
+      Cmdq->Busy &= ~((UINT32)1 << TaskId);
+      SdMmcCompleteAsyncTrb (Task, Status);
+      *Completed = TRUE;
+      EmmcCmdqDiscard (Private, Slot);
+      continue;
+    }
+
+    Cmdq->Running   = TRUE;
+    Cmdq->RunningId = TaskId;
+    Poll = (Task->DataLen <= SD_MMC_HC_POLL_SHORT_LEN) ? SD_MMC_HC_ASYNC_INLINE_POLL : 0;
+  }
+}
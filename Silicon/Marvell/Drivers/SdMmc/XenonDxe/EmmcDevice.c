@@ -1024,6 +1024,7 @@ EmmcSetBusMode (
     DEBUG ((DEBUG_ERROR, "EmmcSetBusMode: GetExtCsd fails with %r\n", Status));
     return Status;
   }
+  EmmcCmdqInit (Private, Slot, Rca, &ExtCsd);
   //
   // Calculate supported bus speed/bus width/clock frequency.
   //
@@ -133,43 +133,103 @@ InitializeSdMmcPciHcDxe (
 }
 
 /**
-  Call back function when the timer event is signaled.
+  Remove a TRB from the async I/O queue, report its completion status and
+  signal its event.
 
-  @param[in]  Event     The Event this notify function registered to.
-  @param[in]  Context   Pointer to the context data registered to the
-                        Event.
+  The caller must be at TPL_NOTIFY.
+
+  @param[in] Trb            The pointer to the SD_MMC_HC_TRB instance.
+  @param[in] Status         The completion status of the TRB.
 
 **/
 VOID
-EFIAPI
-ProcessAsyncTaskList (
-  IN EFI_EVENT          Event,
-  IN VOID*              Context
+SdMmcCompleteAsyncTrb (
+  IN SD_MMC_HC_TRB           *Trb,
+  IN EFI_STATUS              Status
+  )
+{
+  EFI_EVENT                  TrbEvent;
+
+  //
+  // Give the packet of a running command queue task its command back.
+  //
+  if (Trb->CmdqTask && Trb->Started) {
+    Trb->Packet->SdMmcCmdBlk = Trb->Private->Cmdq[Trb->Slot].TaskCmdBlk;
+  }
+
+  RemoveEntryList (&Trb->TrbList);
+  Trb->Packet->TransactionStatus = Status;
+  TrbEvent = Trb->Event;
+  SdMmcRecordLatency (Trb, Status);
+  SdMmcFreeTrb (Trb);
+  DEBUG ((DEBUG_VERBOSE, "SdMmcCompleteAsyncTrb(): Signal Event %p with %r\n", TrbEvent, Status));
+  gBS->SignalEvent (TrbEvent);
+}
+
+/**
+  Advance the asynchronous I/O queue.
+
+  The TRB at the head of the queue is started as soon as the cmd/data lines
+  are ready, and a short transfer is then polled inline for a while. When a
+  TRB completes the next one is started in the same pass, so queued requests
+  do not wait for a timer tick each. The async timer is armed only while the
+  queue is not empty, its interval backing off on the ticks the head TRB is
+  still pending. Read and write requests to an EMMC device supporting the
+  command queue go through it.
+
+  The caller must be at TPL_NOTIFY.
+
+  @param[in]  Private       A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in]  TimerTick     The queue is processed on an async timer tick.
+
+**/
+STATIC
+VOID
+SdMmcProcessAsyncQueue (
+  IN SD_MMC_HC_PRIVATE_DATA           *Private,
+  IN BOOLEAN                          TimerTick
   )
 {
-  SD_MMC_HC_PRIVATE_DATA              *Private;
   LIST_ENTRY                          *Link;
   SD_MMC_HC_TRB                       *Trb;
   EFI_STATUS                          Status;
   EFI_SD_MMC_PASS_THRU_COMMAND_PACKET *Packet;
-  BOOLEAN                             InfiniteWait;
-  EFI_EVENT                           TrbEvent;
+  BOOLEAN                             Completed;
+  BOOLEAN                             CmdqCompleted;
+  UINT32                              Poll;
 
-  Private = (SD_MMC_HC_PRIVATE_DATA*)Context;
+  Completed = FALSE;
 
-  //
-  // Check if the first entry in the async I/O queue is done or not.
-  //
-  Status = EFI_SUCCESS;
-  Trb    = NULL;
-  Link   = GetFirstNode (&Private->Queue);
-  if (!IsNull (&Private->Queue, Link)) {
+  for (Link = GetFirstNode (&Private->Queue);
+       !IsNull (&Private->Queue, Link) && !Private->SyncIo;
+       Link = GetFirstNode (&Private->Queue)) {
     Trb = SD_MMC_HC_TRB_FROM_THIS (Link);
+    if (Private->Cmdq[Trb->Slot].Supported && Private->Slot[Trb->Slot].MediaPresent) {
+      Status = EmmcCmdqProcess (Private, Trb->Slot, &CmdqCompleted);
+      if (CmdqCompleted) {
+        Completed = TRUE;
+      }
+      if (Status != EFI_UNSUPPORTED) {
+        break;
+      }
+      //
+      // The head of the queue goes the legacy way.
+      //
+      Link = GetFirstNode (&Private->Queue);
+      if (IsNull (&Private->Queue, Link)) {
+        break;
+      }
+      Trb = SD_MMC_HC_TRB_FROM_THIS (Link);
+    }
+
+    Packet = Trb->Packet;
+    if (Trb->StartTick == 0) {
+      Trb->StartTick = GetPerformanceCounter ();
+    }
+
     if (!Private->Slot[Trb->Slot].MediaPresent) {
       Status = EFI_NO_MEDIA;
-      goto Done;
-    }
-    if (!Trb->Started) {
+    } else if (!Trb->Started) {
       //
       // Check whether the cmd/data line is ready for transfer.
       //
@@ -177,43 +237,64 @@ ProcessAsyncTaskList (
       if (!EFI_ERROR (Status)) {
         Trb->Started = TRUE;
         Status = SdMmcExecTrb (Private, Trb);
-        if (EFI_ERROR (Status)) {
-          goto Done;
+        if (!EFI_ERROR (Status)) {
+          Poll   = (Trb->DataLen <= SD_MMC_HC_POLL_SHORT_LEN) ? SD_MMC_HC_ASYNC_INLINE_POLL : 0;
+          Status = SdMmcCheckTrbResult (Private, Trb);
+          while ((Status == EFI_NOT_READY) && (Poll-- > 0)) {
+            gBS->Stall (1);
+            Status = SdMmcCheckTrbResult (Private, Trb);
+          }
         }
-      } else {
-        goto Done;
       }
-    }
-    Status = SdMmcCheckTrbResult (Private, Trb);
-  }
-
-Done:
-  if ((Trb != NULL) && (Status == EFI_NOT_READY)) {
-    Packet = Trb->Packet;
-    if (Packet->Timeout == 0) {
-      InfiniteWait = TRUE;
     } else {
-      InfiniteWait = FALSE;
+      Status = SdMmcCheckTrbResult (Private, Trb);
     }
-    if ((!InfiniteWait) && (Trb->Timeout-- == 0)) {
-      RemoveEntryList (Link);
-      Trb->Packet->TransactionStatus = EFI_TIMEOUT;
-      TrbEvent = Trb->Event;
-      SdMmcFreeTrb (Trb);
-      DEBUG ((DEBUG_VERBOSE, "ProcessAsyncTaskList(): Signal Event %p EFI_TIMEOUT\n", TrbEvent));
-      gBS->SignalEvent (TrbEvent);
-      return;
+
+    if (Status == EFI_NOT_READY) {
+      //
+      // The packet time out is in microseconds, as for the blocking I/O.
+      //
+      if ((Packet->Timeout == 0) ||
+          (SdMmcGetElapsedTime (Trb->StartTick) < MultU64x32 (Packet->Timeout, 1000))) {
+        break;
+      }
+      Status = EFI_TIMEOUT;
     }
+
+    SdMmcCompleteAsyncTrb (Trb, Status);
+    Completed = TRUE;
   }
-  if ((Trb != NULL) && (Status != EFI_NOT_READY)) {
-    RemoveEntryList (Link);
-    Trb->Packet->TransactionStatus = Status;
-    TrbEvent = Trb->Event;
-    SdMmcFreeTrb (Trb);
-    DEBUG ((DEBUG_VERBOSE, "ProcessAsyncTaskList(): Signal Event %p with %r\n", TrbEvent, Status));
-    gBS->SignalEvent (TrbEvent);
+
+  if (IsListEmpty (&Private->Queue)) {
+    Private->AsyncInterval = SD_MMC_HC_ASYNC_TIMER_MIN;
+    gBS->SetTimer (Private->TimerEvent, TimerCancel, 0);
+    return;
   }
-  return;
+
+  if (Completed) {
+    Private->AsyncInterval = SD_MMC_HC_ASYNC_TIMER_MIN;
+  } else if (TimerTick) {
+    Private->AsyncInterval = MIN (Private->AsyncInterval * 2, SD_MMC_HC_ASYNC_TIMER);
+  }
+  gBS->SetTimer (Private->TimerEvent, TimerRelative, Private->AsyncInterval);
+}
+
+/**
+  Call back function when the timer event is signaled.
+
+  @param[in]  Event     The Event this notify function registered to.
+  @param[in]  Context   Pointer to the context data registered to the
+                        Event.
+
+**/
+VOID
+EFIAPI
+ProcessAsyncTaskList (
+  IN EFI_EVENT          Event,
+  IN VOID*              Context
+  )
+{
+  SdMmcProcessAsyncQueue ((SD_MMC_HC_PRIVATE_DATA*)Context, TRUE);
 }
 
 /**
@@ -262,12 +343,10 @@ SdMmcPciHcEnumerateDevice (
           NextLink = GetNextNode (&Private->Queue, Link);
           Trb = SD_MMC_HC_TRB_FROM_THIS (Link);
           if (Trb->Slot == Slot) {
-            RemoveEntryList (Link);
-            Trb->Packet->TransactionStatus = EFI_NO_MEDIA;
-            gBS->SignalEvent (Trb->Event);
-            SdMmcFreeTrb (Trb);
+            SdMmcCompleteAsyncTrb (Trb, EFI_NO_MEDIA);
           }
         }
+        EmmcCmdqReset (Private, Slot);
         gBS->RestoreTPL (OldTpl);
         //
         // Notify the upper layer the connect state change through ReinstallProtocolInterface.
@@ -611,6 +690,12 @@ SdMmcPciHcDriverBindingStart (
 
   Support64BitDma &= Private->Capability[Slot].SysBus64;
 
+  //
+  // Use 96-bit descriptors of 64-bit ADMA2, so that data and descriptor
+  // tables mapped above 4GB can be reached.
+  //
+  Private->AdmaDma64[Slot] = Support64BitDma;
+
   //
   // Override capabilities structure - only 4 Bit width bus is supported
   // by HW and also force using SDR25 mode
@@ -652,6 +737,13 @@ SdMmcPciHcDriverBindingStart (
     return Status;
   }
 
+  if (Private->Capability[Slot].Adma2 != 0) {
+    Status = SdMmcHcAdmaPoolInit (Private, Slot);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "SdMmcPciHcDriverBindingStart: no ADMA descriptor pool (%r)\n", Status));
+    }
+  }
+
   Private->Slot[Slot].MediaPresent = TRUE;
   Private->Slot[Slot].Initialized  = TRUE;
   RoutineNum = sizeof (mCardTypeDetectRoutineTable) / sizeof (CARD_TYPE_DETECT_ROUTINE);
@@ -688,7 +780,7 @@ SdMmcPciHcDriverBindingStart (
   }
 
   //
-  // Start the asynchronous I/O monitor
+  // Create the asynchronous I/O monitor, it is armed when async I/O is queued.
   //
   Status = gBS->CreateEvent (
                   EVT_TIMER | EVT_NOTIFY_SIGNAL,
@@ -700,11 +792,7 @@ SdMmcPciHcDriverBindingStart (
   if (EFI_ERROR (Status)) {
     goto Done;
   }
-
-  Status = gBS->SetTimer (Private->TimerEvent, TimerPeriodic, SD_MMC_HC_ASYNC_TIMER);
-  if (EFI_ERROR (Status)) {
-    goto Done;
-  }
+  Private->AsyncInterval = SD_MMC_HC_ASYNC_TIMER_MIN;
 
   //
   // Start the Sd removable device connection enumeration
@@ -812,6 +900,7 @@ SdMmcPciHcDriverBindingStop (
   LIST_ENTRY                          *Link;
   LIST_ENTRY                          *NextLink;
   SD_MMC_HC_TRB                       *Trb;
+  UINT8                               Slot;
 
   DEBUG ((DEBUG_INFO, "SdMmcPciHcDriverBindingStop: Start\n"));
 
@@ -847,11 +936,8 @@ SdMmcPciHcDriverBindingStop (
        !IsNull (&Private->Queue, Link);
        Link = NextLink) {
     NextLink = GetNextNode (&Private->Queue, Link);
-    RemoveEntryList (Link);
     Trb = SD_MMC_HC_TRB_FROM_THIS (Link);
-    Trb->Packet->TransactionStatus = EFI_ABORTED;
-    gBS->SignalEvent (Trb->Event);
-    SdMmcFreeTrb (Trb);
+    SdMmcCompleteAsyncTrb (Trb, EFI_ABORTED);
   }
 
   //
@@ -867,6 +953,12 @@ SdMmcPciHcDriverBindingStop (
     return Status;
   }
 
+  SdMmcPrintLatency (Private);
+
+  for (Slot = 0; Slot < SD_MMC_HC_MAX_SLOT; Slot++) {
+    SdMmcHcAdmaPoolFree (Private, Slot);
+  }
+
   gBS->CloseProtocol (
          Controller,
          &gEfiPciIoProtocolGuid,
@@ -942,6 +1034,7 @@ SdMmcPassThruPassThru (
   SD_MMC_HC_PRIVATE_DATA          *Private;
   SD_MMC_HC_TRB                   *Trb;
   EFI_TPL                         OldTpl;
+  BOOLEAN                         SyncIo;
 
   if ((This == NULL) || (Packet == NULL)) {
     return EFI_INVALID_PARAMETER;
@@ -978,24 +1071,44 @@ SdMmcPassThruPassThru (
     return EFI_OUT_OF_RESOURCES;
   }
   //
-  // Immediately return for async I/O.
+  // Start async I/O right away if the queue is idle, and return.
   //
   if (Event != NULL) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    SdMmcProcessAsyncQueue (Private, FALSE);
+    gBS->RestoreTPL (OldTpl);
     return EFI_SUCCESS;
   }
 
   //
-  // Wait async I/O list is empty before execute sync I/O operation.
+  // Drain the async I/O list before execute sync I/O operation, and hold
+  // the async I/O queued meanwhile until it is done. A sync I/O nested in
+  // another one does not wait for the async I/O held by that one.
   //
   while (TRUE) {
     OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
-    if (IsListEmpty (&Private->Queue)) {
+    SdMmcProcessAsyncQueue (Private, FALSE);
+    if (IsListEmpty (&Private->Queue) || Private->SyncIo) {
+      SyncIo          = Private->SyncIo;
+      Private->SyncIo = TRUE;
       gBS->RestoreTPL (OldTpl);
       break;
     }
     gBS->RestoreTPL (OldTpl);
   }
 
+  //
+  // Sync I/O is sent the legacy way. SEND_STATUS is also accepted in command
+  // queue mode, it does not switch the command queue off.
+  //
+  if (Packet->SdMmcCmdBlk->CommandIndex != EMMC_SEND_STATUS) {
+    Status = EmmcCmdqDisable (Private, Slot);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "SdMmcPassThruPassThru: cannot leave command queue mode for CMD%d: %r\n", Packet->SdMmcCmdBlk->CommandIndex, Status));
+      goto Done;
+    }
+  }
+
   Status = SdMmcWaitTrbEnv (Private, Trb);
   if (EFI_ERROR (Status)) {
     goto Done;
@@ -1012,13 +1125,21 @@ SdMmcPassThruPassThru (
   }
 
 Done:
-  if ((Trb != NULL) && (Trb->AdmaDesc != NULL)) {
-    FreePages (Trb->AdmaDesc, Trb->AdmaPages);
+  if (Trb != NULL) {
+    SdMmcRecordLatency (Trb, Status);
+    SdMmcFreeTrb (Trb);
   }
 
-  if (Trb != NULL) {
-    FreePool (Trb);
+  //
+  // Release the async I/O queue, and restart the requests held meanwhile
+  // instead of leaving them to the next timer tick.
+  //
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  Private->SyncIo = SyncIo;
+  if (!SyncIo) {
+    SdMmcProcessAsyncQueue (Private, FALSE);
   }
+  gBS->RestoreTPL (OldTpl);
 
   return Status;
 }
@@ -1302,15 +1423,14 @@ SdMmcPassThruResetDevice (
   //
   OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
 
+  EmmcCmdqAbort (Private, Slot);
+
   for (Link = GetFirstNode (&Private->Queue);
        !IsNull (&Private->Queue, Link);
        Link = NextLink) {
     NextLink = GetNextNode (&Private->Queue, Link);
-    RemoveEntryList (Link);
     Trb = SD_MMC_HC_TRB_FROM_THIS (Link);
-    Trb->Packet->TransactionStatus = EFI_ABORTED;
-    gBS->SignalEvent (Trb->Event);
-    SdMmcFreeTrb (Trb);
+    SdMmcCompleteAsyncTrb (Trb, EFI_ABORTED);
   }
 
   gBS->RestoreTPL (OldTpl);
@@ -29,6 +29,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/MemoryAllocationLib.h>
 #include <Library/UefiLib.h>
 #include <Library/DevicePathLib.h>
+#include <Library/TimerLib.h>
 
 #include <Protocol/DevicePath.h>
 #include <Protocol/PciIo.h>
@@ -59,6 +60,25 @@ extern EFI_DRIVER_BINDING_PROTOCOL  gSdMmcPciHcDriverBinding;
 //
 #define SD_MMC_HC_ASYNC_TIMER   EFI_TIMER_PERIOD_MILLISECONDS(1)
 //
+// Shortest async transfer timer interval. The timer is armed only while the
+// async queue is not empty, starting at this interval and doubling up to
+// SD_MMC_HC_ASYNC_TIMER while the TRB at the head of the queue is pending.
+// The unit is 100ns, takes 50us as interval.
+//
+#define SD_MMC_HC_ASYNC_TIMER_MIN     EFI_TIMER_PERIOD_MICROSECONDS(50)
+//
+// Completion polling of TRBs, set by experience. Transfers of at most
+// SD_MMC_HC_POLL_SHORT_LEN bytes are polled back to back up to
+// SD_MMC_HC_POLL_SPIN times before the stall between two polls starts
+// doubling from 1us up to SD_MMC_HC_POLL_MAX_STALL us. A short async
+// transfer is polled inline for up to SD_MMC_HC_ASYNC_INLINE_POLL us after
+// it is started, before it is left to the async timer.
+//
+#define SD_MMC_HC_POLL_SHORT_LEN      SIZE_4KB
+#define SD_MMC_HC_POLL_SPIN           256
+#define SD_MMC_HC_POLL_MAX_STALL      64
+#define SD_MMC_HC_ASYNC_INLINE_POLL   20
+//
 // SD/MMC removable device enumeration timer interval, set by experience.
 // The unit is 100us, takes 100ms as interval.
 //
@@ -87,6 +107,74 @@ typedef struct {
   SD_MMC_CARD_TYPE                  CardType;
 } SD_MMC_HC_SLOT;
 
+//
+// Latency of the TRBs completed on a slot, from submission to completion.
+// Histogram[n] counts the TRBs completed in [2^n, 2^(n+1)) microseconds,
+// the first bucket also takes faster ones and the last one slower ones.
+//
+#define SD_MMC_HC_LATENCY_BUCKETS     16
+
+typedef struct {
+  UINT64                            Count;
+  UINT64                            Errors;
+  UINT64                            TotalNs;
+  UINT64                            MinNs;
+  UINT64                            MaxNs;
+  UINT64                            Histogram[SD_MMC_HC_LATENCY_BUCKETS];
+} SD_MMC_HC_LATENCY;
+
+//
+// EMMC command queue commands and EXT_CSD fields.
+// Refer to EMMC Electrical Standard Spec 5.1 Section 6.6.39 for details.
+//
+#define EMMC_QUEUED_TASK_PARAMS       44
+#define EMMC_QUEUED_TASK_ADDRESS      45
+#define EMMC_EXECUTE_READ_TASK        46
+#define EMMC_EXECUTE_WRITE_TASK       47
+#define EMMC_CMDQ_TASK_MGMT           48
+
+#define EMMC_EXT_CSD_CMDQ_MODE_EN     15
+#define EMMC_EXT_CSD_CMDQ_DEPTH       307
+#define EMMC_EXT_CSD_CMDQ_SUPPORT     308
+
+#define EMMC_CMDQ_MAX_DEPTH           32
+
+//
+// The command queue is only switched on for this many read and write
+// requests waiting in the async I/O queue, a lone request gains nothing
+// from it and goes the legacy way.
+//
+#define SD_MMC_HC_CMDQ_MIN_TASKS      2
+
+//
+// EMMC command queue of a slot. Read and write requests queued for async
+// I/O are sent to the device as tasks, which the device prepares in parallel
+// and runs in the order it reports them ready.
+//
+typedef struct {
+  BOOLEAN                           Supported;
+  BOOLEAN                           Enabled;
+  UINT8                             Depth;
+  UINT16                            Rca;
+  //
+  // Task IDs queued on the device, and the task moving data
+  //
+  UINT32                            Busy;
+  BOOLEAN                           Running;
+  UINT8                             RunningId;
+  EFI_SD_MMC_COMMAND_BLOCK          ExecCmdBlk;
+  EFI_SD_MMC_COMMAND_BLOCK          *TaskCmdBlk;
+  //
+  // SWITCH of CMDQ_MODE_EN, and the SEND_STATUS checking it, run from the
+  // async I/O queue without waiting for the device
+  //
+  struct _SD_MMC_HC_TRB             *SwitchTrb;
+  BOOLEAN                           SwitchEnable;
+  EFI_SD_MMC_PASS_THRU_COMMAND_PACKET SwitchPacket;
+  EFI_SD_MMC_COMMAND_BLOCK          SwitchCmdBlk;
+  EFI_SD_MMC_STATUS_BLOCK           SwitchStatusBlk;
+} SD_MMC_HC_CMDQ;
+
 typedef struct {
   UINTN                               Signature;
 
@@ -104,6 +192,7 @@ typedef struct {
   // For Non-blocking operation.
   //
   EFI_EVENT                           TimerEvent;
+  UINT64                              AsyncInterval;
   //
   // For Sd removable device enumeration.
   //
@@ -121,6 +210,29 @@ typedef struct {
   // value stored in Capabilities Register 1.
   //
   UINT32                              BaseClkFreq[SD_MMC_HC_MAX_SLOT];
+
+  //
+  // SET_BLOCK_COUNT command preceding the next data transfer on each slot.
+  // A deferred command is sent by the host controller as Auto CMD23 with
+  // the argument kept in BlkCountArg.
+  //
+  SD_MMC_BLK_COUNT_STATE              BlkCountState[SD_MMC_HC_MAX_SLOT];
+  UINT32                              BlkCountArg[SD_MMC_HC_MAX_SLOT];
+
+  //
+  // 64-bit ADMA2 descriptors are used, and the pool of descriptor tables
+  // of each slot.
+  //
+  BOOLEAN                             AdmaDma64[SD_MMC_HC_MAX_SLOT];
+  SD_MMC_HC_ADMA_POOL                 AdmaPool[SD_MMC_HC_MAX_SLOT];
+
+  SD_MMC_HC_LATENCY                   Latency[SD_MMC_HC_MAX_SLOT];
+
+  SD_MMC_HC_CMDQ                      Cmdq[SD_MMC_HC_MAX_SLOT];
+  //
+  // A blocking request owns the host controller, the async queue waits.
+  //
+  BOOLEAN                             SyncIo;
 } SD_MMC_HC_PRIVATE_DATA;
 
 #define SD_MMC_HC_TRB_SIG             SIGNATURE_32 ('T', 'R', 'B', 'T')
@@ -128,7 +240,7 @@ typedef struct {
 //
 // TRB (Transfer Request Block) contains information for the cmd request.
 //
-typedef struct {
+typedef struct _SD_MMC_HC_TRB {
   UINT32                              Signature;
   LIST_ENTRY                          TrbList;
 
@@ -145,12 +257,36 @@ typedef struct {
 
   EFI_EVENT                           Event;
   BOOLEAN                             Started;
-  UINT64                              Timeout;
+  //
+  // Performance counter values when the TRB was created and when it was
+  // first processed at the head of the async queue
+  //
+  UINT64                              SubmitTick;
+  UINT64                              StartTick;
+  //
+  // SET_BLOCK_COUNT command left to the host controller as Auto CMD23
+  //
+  BOOLEAN                             Deferred;
+  //
+  // Bytes moved through the Buffer Data Port in PIO mode
+  //
+  UINT32                              PioLength;
+  //
+  // Queued on the device as a task of the EMMC command queue
+  //
+  BOOLEAN                             CmdqTask;
+  UINT8                               CmdqTaskId;
+  BOOLEAN                             CmdqReliable;
 
-  SD_MMC_HC_ADMA_DESC_LINE            *AdmaDesc;
+  VOID                                *AdmaDesc;
   EFI_PHYSICAL_ADDRESS                AdmaDescPhy;
   VOID                                *AdmaMap;
   UINT32                              AdmaPages;
+  //
+  // Descriptor table taken from the slot's pool
+  //
+  BOOLEAN                             AdmaPooled;
+  UINT32                              AdmaPoolIndex;
 
   SD_MMC_HC_PRIVATE_DATA              *Private;
 } SD_MMC_HC_TRB;
@@ -658,6 +794,36 @@ SdMmcCreateTrb (
   IN EFI_EVENT                           Event
   );
 
+/**
+  Allocate and map the pool of ADMA descriptor tables of the slot.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the SD card.
+
+  @retval EFI_SUCCESS       The pool is ready for use.
+  @retval Others            The pool can't be allocated. Descriptor tables
+                            are then allocated for each TRB.
+
+**/
+EFI_STATUS
+SdMmcHcAdmaPoolInit (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  );
+
+/**
+  Unmap and free the pool of ADMA descriptor tables of the slot.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the SD card.
+
+**/
+VOID
+SdMmcHcAdmaPoolFree (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  );
+
 /**
   Free the resource used by the TRB.
 
@@ -669,6 +835,59 @@ SdMmcFreeTrb (
   IN SD_MMC_HC_TRB           *Trb
   );
 
+/**
+  Get the time elapsed since the specified performance counter value.
+
+  @param[in] StartTick      The performance counter value to measure from.
+
+  @return The elapsed time in nanoseconds.
+
+**/
+UINT64
+SdMmcGetElapsedTime (
+  IN UINT64                  StartTick
+  );
+
+/**
+  Account the latency of a completed TRB to the statistics of its slot.
+
+  @param[in] Trb            The pointer to the SD_MMC_HC_TRB instance.
+  @param[in] Status         The completion status of the TRB.
+
+**/
+VOID
+SdMmcRecordLatency (
+  IN SD_MMC_HC_TRB           *Trb,
+  IN EFI_STATUS              Status
+  );
+
+/**
+  Print the TRB latency statistics of all slots of the host controller.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+
+**/
+VOID
+SdMmcPrintLatency (
+  IN SD_MMC_HC_PRIVATE_DATA  *Private
+  );
+
+/**
+  Remove a TRB from the async I/O queue, report its completion status and
+  signal its event.
+
+  The caller must be at TPL_NOTIFY.
+
+  @param[in] Trb            The pointer to the SD_MMC_HC_TRB instance.
+  @param[in] Status         The completion status of the TRB.
+
+**/
+VOID
+SdMmcCompleteAsyncTrb (
+  IN SD_MMC_HC_TRB           *Trb,
+  IN EFI_STATUS              Status
+  );
+
 /**
   Check if the env is ready for execute specified TRB.
 
@@ -788,4 +1007,98 @@ SdCardIdentification (
   IN UINT8                              Slot
   );
 
+/**
+  Check the EMMC command queue support of the device from its EXT_CSD register.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+  @param[in] Rca            The relative device address of the device.
+  @param[in] ExtCsd         The content of the EXT_CSD register.
+
+**/
+VOID
+EmmcCmdqInit (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot,
+  IN UINT16                             Rca,
+  IN EMMC_EXT_CSD                       *ExtCsd
+  );
+
+/**
+  Disable the EMMC command queue of the device, for the next command to be
+  sent the legacy way. The SWITCH command is waited for, this is not to be
+  called from the async I/O queue.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+
+  @retval EFI_SUCCESS       The command queue is disabled.
+  @retval EFI_NOT_READY     Tasks are queued on the device, or a switch of
+                            the command queue is in progress.
+  @retval Others            The SWITCH command fails.
+
+**/
+EFI_STATUS
+EmmcCmdqDisable (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  );
+
+/**
+  Stop the running task and discard all tasks queued on the EMMC device, for
+  the requests of the async I/O queue to be aborted.
+
+  The caller must be at TPL_NOTIFY.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+
+**/
+VOID
+EmmcCmdqAbort (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  );
+
+/**
+  Forget the EMMC command queue state of a slot whose device is removed.
+
+  The caller must be at TPL_NOTIFY.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+
+**/
+VOID
+EmmcCmdqReset (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  );
+
+/**
+  Advance the async I/O queue of a slot through the EMMC command queue.
+
+  Read and write requests at the head of the async I/O queue are sent to the
+  device as tasks, up to the queue depth, and the task the device reports
+  ready is run. Completed requests are removed from the async I/O queue.
+
+  The caller must be at TPL_NOTIFY.
+
+  @param[in]  Private       A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in]  Slot          The slot number of the EMMC device.
+  @param[out] Completed     Set to TRUE if a request is completed.
+
+  @retval EFI_SUCCESS       The async I/O queue is handled by the command queue.
+  @retval EFI_UNSUPPORTED   The request at the head of the async I/O queue is
+                            to be run the legacy way, the command queue is
+                            disabled.
+
+**/
+EFI_STATUS
+EmmcCmdqProcess (
+  IN  SD_MMC_HC_PRIVATE_DATA            *Private,
+  IN  UINT8                             Slot,
+  OUT BOOLEAN                           *Completed
+  );
+
 #endif
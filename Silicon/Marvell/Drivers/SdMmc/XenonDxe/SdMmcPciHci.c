@@ -16,6 +16,7 @@
 **/
 
 #include "SdMmcPciHcDxe.h"
+#include "XenonSdhci.h"
 
 /**
   Dump the content of SD/MMC host controller's Capability Register.
@@ -421,6 +422,87 @@ SdMmcHcWaitMmioSet (
   return EFI_TIMEOUT;
 }
 
+/**
+  Move data blocks through the Buffer Data Port of the specified slot.
+
+  Whole blocks are moved with 32-bit FIFO accesses for as long as the Present
+  State register reports the buffer ready, so a single Buffer Read/Write Ready
+  event may move several blocks.
+
+  @param[in]      PciIo         The PCI IO protocol instance.
+  @param[in]      Slot          The slot number of the SD card.
+  @param[in]      Read          TRUE to read data from the card.
+  @param[in]      BlockSize     The size of a data block in bytes, a multiple of 4.
+  @param[in, out] Data          The data buffer of the transfer.
+  @param[in]      DataLen       The length of the whole transfer in bytes.
+  @param[in, out] Offset        The number of bytes already moved, updated on
+                                return.
+
+  @retval EFI_SUCCESS           All blocks available in the buffer are moved.
+  @retval Others                The Buffer Data Port access fails.
+
+**/
+EFI_STATUS
+SdMmcHcPioTransfer (
+  IN     EFI_PCI_IO_PROTOCOL  *PciIo,
+  IN     UINT8                Slot,
+  IN     BOOLEAN              Read,
+  IN     UINT16               BlockSize,
+  IN OUT UINT8                *Data,
+  IN     UINT32               DataLen,
+  IN OUT UINT32               *Offset
+  )
+{
+  EFI_STATUS                  Status;
+  UINT32                      PresentState;
+  UINT32                      Ready;
+
+  //
+  // Buffer Read Enable or Buffer Write Enable
+  //
+  Ready = Read ? BIT11 : BIT10;
+
+  while (*Offset + BlockSize <= DataLen) {
+    Status = SdMmcHcRwMmio (PciIo, Slot, SD_MMC_HC_PRESENT_STATE, TRUE, sizeof (PresentState), &PresentState);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    if ((PresentState & Ready) == 0) {
+      break;
+    }
+
+    //
+    // The Buffer Data Port is a FIFO, it must be accessed 32 bits at a time.
+    //
+    if (Read) {
+      Status = PciIo->Mem.Read (
+                            PciIo,
+                            EfiPciIoWidthFifoUint32,
+                            Slot,
+                            SD_MMC_HC_BUF_DAT_PORT,
+                            BlockSize / sizeof (UINT32),
+                            Data + *Offset
+                            );
+    } else {
+      Status = PciIo->Mem.Write (
+                            PciIo,
+                            EfiPciIoWidthFifoUint32,
+                            Slot,
+                            SD_MMC_HC_BUF_DAT_PORT,
+                            BlockSize / sizeof (UINT32),
+                            Data + *Offset
+                            );
+    }
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+
+    *Offset += BlockSize;
+  }
+
+  return EFI_SUCCESS;
+}
+
 /**
   Software reset the specified SD/MMC host controller and enable all interrupts.
 
@@ -1090,51 +1172,171 @@ SdMmcHcLedOnOff (
 }
 
 /**
-  Build ADMA descriptor table for transfer.
+  Allocate and map the pool of ADMA descriptor tables of the slot.
 
-  Refer to SD Host Controller Simplified spec 3.0 Section 1.13 for details.
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the SD card.
 
-  @param[in] Trb            The pointer to the SD_MMC_HC_TRB instance.
-
-  @retval EFI_SUCCESS       The ADMA descriptor table is created successfully.
-  @retval Others            The ADMA descriptor table isn't created successfully.
+  @retval EFI_SUCCESS       The pool is ready for use.
+  @retval Others            The pool can't be allocated. Descriptor tables
+                            are then allocated for each TRB.
 
 **/
 EFI_STATUS
-BuildAdmaDescTable (
-  IN SD_MMC_HC_TRB          *Trb
+SdMmcHcAdmaPoolInit (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
   )
 {
-  EFI_PHYSICAL_ADDRESS      Data;
-  UINT64                    DataLen;
-  UINT64                    Entries;
-  UINT32                    Index;
-  UINT64                    Remaining;
-  UINT32                    Address;
-  UINTN                     TableSize;
+  SD_MMC_HC_ADMA_POOL       *Pool;
   EFI_PCI_IO_PROTOCOL       *PciIo;
   EFI_STATUS                Status;
+  UINTN                     PoolSize;
   UINTN                     Bytes;
 
-  Data    = Trb->DataPhy;
-  DataLen = Trb->DataLen;
-  PciIo   = Trb->Private->PciIo;
-  //
-  // Only support 32bit ADMA Descriptor Table
-  //
-  if ((Data >= 0x100000000ul) || ((Data + DataLen) > 0x100000000ul)) {
-    return EFI_INVALID_PARAMETER;
+  Pool     = &Private->AdmaPool[Slot];
+  PciIo    = Private->PciIo;
+  PoolSize = SD_MMC_HC_ADMA_POOL_TABLES * SD_MMC_HC_ADMA_POOL_TABLE_SIZE;
+
+  Pool->Pages = (UINT32)EFI_SIZE_TO_PAGES (PoolSize);
+  Status = PciIo->AllocateBuffer (
+                    PciIo,
+                    AllocateAnyPages,
+                    EfiBootServicesData,
+                    Pool->Pages,
+                    (VOID **)&Pool->Desc,
+                    0
+                    );
+  if (EFI_ERROR (Status)) {
+    Pool->Desc = NULL;
+    return Status;
+  }
+
+  Bytes  = PoolSize;
+  Status = PciIo->Map (
+                    PciIo,
+                    EfiPciIoOperationBusMasterCommonBuffer,
+                    Pool->Desc,
+                    &Bytes,
+                    &Pool->DescPhy,
+                    &Pool->Map
+                    );
+  if (!EFI_ERROR (Status) && (Bytes == PoolSize) &&
+      (Private->AdmaDma64[Slot] || ((Pool->DescPhy + PoolSize) <= 0x100000000ul))) {
+    ZeroMem (Pool->InUse, sizeof (Pool->InUse));
+    return EFI_SUCCESS;
+  }
+
+  if (!EFI_ERROR (Status)) {
+    PciIo->Unmap (PciIo, Pool->Map);
+  }
+  PciIo->FreeBuffer (PciIo, Pool->Pages, Pool->Desc);
+  Pool->Desc = NULL;
+  Pool->Map  = NULL;
+  return EFI_OUT_OF_RESOURCES;
+}
+
+/**
+  Unmap and free the pool of ADMA descriptor tables of the slot.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the SD card.
+
+**/
+VOID
+SdMmcHcAdmaPoolFree (
+  IN SD_MMC_HC_PRIVATE_DATA             *Private,
+  IN UINT8                              Slot
+  )
+{
+  SD_MMC_HC_ADMA_POOL       *Pool;
+  EFI_PCI_IO_PROTOCOL       *PciIo;
+
+  Pool  = &Private->AdmaPool[Slot];
+  PciIo = Private->PciIo;
+
+  if (Pool->Desc == NULL) {
+    return;
+  }
+
+  PciIo->Unmap (PciIo, Pool->Map);
+  PciIo->FreeBuffer (PciIo, Pool->Pages, Pool->Desc);
+  Pool->Desc = NULL;
+  Pool->Map  = NULL;
+}
+
+/**
+  Take a descriptor table from the pool of the TRB's slot.
+
+  @param[in] Trb            The pointer to the SD_MMC_HC_TRB instance.
+  @param[in] TableSize      The size of the descriptor table in bytes.
+
+  @retval EFI_SUCCESS       A descriptor table is assigned to the TRB.
+  @retval EFI_NOT_FOUND     No descriptor table of the pool can be used.
+
+**/
+STATIC
+EFI_STATUS
+SdMmcHcAdmaPoolGet (
+  IN SD_MMC_HC_TRB          *Trb,
+  IN UINTN                  TableSize
+  )
+{
+  SD_MMC_HC_ADMA_POOL       *Pool;
+  EFI_STATUS                Status;
+  EFI_TPL                   OldTpl;
+  UINT32                    Index;
+
+  Pool = &Trb->Private->AdmaPool[Trb->Slot];
+
+  if ((Pool->Desc == NULL) || (TableSize > SD_MMC_HC_ADMA_POOL_TABLE_SIZE)) {
+    return EFI_NOT_FOUND;
   }
+
   //
-  // Address field shall be set on 32-bit boundary (Lower 2-bit is always set to 0)
-  // for 32-bit address descriptor table.
+  // Tables are released from the asynchronous I/O monitor at TPL_NOTIFY
   //
-  if ((Data & (BIT0 | BIT1)) != 0) {
-    DEBUG ((DEBUG_INFO, "The buffer [0x%x] to construct ADMA desc is not aligned to 4 bytes boundary!\n", Data));
+  Status = EFI_NOT_FOUND;
+  OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+  for (Index = 0; Index < SD_MMC_HC_ADMA_POOL_TABLES; Index++) {
+    if (!Pool->InUse[Index]) {
+      Pool->InUse[Index] = TRUE;
+      Trb->AdmaPooled    = TRUE;
+      Trb->AdmaPoolIndex = Index;
+      Trb->AdmaDesc      = Pool->Desc + Index * SD_MMC_HC_ADMA_POOL_TABLE_SIZE;
+      Trb->AdmaDescPhy   = Pool->DescPhy + Index * SD_MMC_HC_ADMA_POOL_TABLE_SIZE;
+      Status = EFI_SUCCESS;
+      break;
+    }
   }
+  gBS->RestoreTPL (OldTpl);
+
+  return Status;
+}
+
+/**
+  Allocate and map a descriptor table for the TRB only.
+
+  @param[in] Trb            The pointer to the SD_MMC_HC_TRB instance.
+  @param[in] TableSize      The size of the descriptor table in bytes.
+
+  @retval EFI_SUCCESS       A descriptor table is assigned to the TRB.
+  @retval Others            The descriptor table can't be allocated.
+
+**/
+STATIC
+EFI_STATUS
+SdMmcHcAdmaDescAllocate (
+  IN SD_MMC_HC_TRB          *Trb,
+  IN UINTN                  TableSize
+  )
+{
+  EFI_PCI_IO_PROTOCOL       *PciIo;
+  EFI_STATUS                Status;
+  UINTN                     Bytes;
+
+  PciIo = Trb->Private->PciIo;
 
-  Entries   = DivU64x32 ((DataLen + ADMA_MAX_DATA_PER_LINE - 1), ADMA_MAX_DATA_PER_LINE);
-  TableSize = (UINTN)MultU64x32 (Entries, sizeof (SD_MMC_HC_ADMA_DESC_LINE));
   Trb->AdmaPages = (UINT32)EFI_SIZE_TO_PAGES (TableSize);
   Status = PciIo->AllocateBuffer (
                     PciIo,
@@ -1145,9 +1347,9 @@ BuildAdmaDescTable (
                     0
                     );
   if (EFI_ERROR (Status)) {
+    Trb->AdmaDesc = NULL;
     return EFI_OUT_OF_RESOURCES;
   }
-  ZeroMem (Trb->AdmaDesc, TableSize);
   Bytes  = TableSize;
   Status = PciIo->Map (
                     PciIo,
@@ -1162,17 +1364,23 @@ BuildAdmaDescTable (
     //
     // Map error or unable to map the whole RFis buffer into a contiguous region.
     //
+    if (!EFI_ERROR (Status)) {
+      PciIo->Unmap (PciIo, Trb->AdmaMap);
+      Trb->AdmaMap = NULL;
+    }
     PciIo->FreeBuffer (
              PciIo,
              EFI_SIZE_TO_PAGES (TableSize),
              Trb->AdmaDesc
              );
+    Trb->AdmaDesc = NULL;
     return EFI_OUT_OF_RESOURCES;
   }
 
-  if ((UINT64)(UINTN)Trb->AdmaDescPhy > 0x100000000ul) {
+  if (!Trb->Private->AdmaDma64[Trb->Slot] &&
+      ((UINT64)(UINTN)Trb->AdmaDescPhy + TableSize > 0x100000000ul)) {
     //
-    // The ADMA doesn't support 64bit addressing.
+    // The 32-bit ADMA doesn't support 64bit addressing.
     //
     PciIo->Unmap (
       PciIo,
@@ -1183,23 +1391,108 @@ BuildAdmaDescTable (
       EFI_SIZE_TO_PAGES (TableSize),
       Trb->AdmaDesc
     );
+    Trb->AdmaMap  = NULL;
+    Trb->AdmaDesc = NULL;
     return EFI_DEVICE_ERROR;
   }
 
-  Remaining = DataLen;
-  Address   = (UINT32)Data;
+  return EFI_SUCCESS;
+}
+
+/**
+  Build ADMA descriptor table for transfer.
+
+  Refer to SD Host Controller Simplified spec 3.0 Section 1.13 for details.
+
+  @param[in] Trb            The pointer to the SD_MMC_HC_TRB instance.
+
+  @retval EFI_SUCCESS       The ADMA descriptor table is created successfully.
+  @retval Others            The ADMA descriptor table isn't created successfully.
+
+**/
+EFI_STATUS
+BuildAdmaDescTable (
+  IN SD_MMC_HC_TRB          *Trb
+  )
+{
+  EFI_PHYSICAL_ADDRESS        Data;
+  UINT64                      DataLen;
+  UINT64                      Entries;
+  UINT32                      Index;
+  UINT64                      Remaining;
+  UINT64                      Address;
+  UINT16                      Length;
+  UINTN                       TableSize;
+  EFI_STATUS                  Status;
+  BOOLEAN                     Dma64;
+  SD_MMC_HC_ADMA_DESC_LINE    *AdmaDesc;
+  SD_MMC_HC_ADMA_64_DESC_LINE *AdmaDesc64;
+
+  Data    = Trb->DataPhy;
+  DataLen = Trb->DataLen;
+  Dma64   = Trb->Private->AdmaDma64[Trb->Slot];
+  //
+  // 32bit ADMA Descriptor Table only covers the lowest 4GB
+  //
+  if (!Dma64 && ((Data >= 0x100000000ul) || ((Data + DataLen) > 0x100000000ul))) {
+    return EFI_INVALID_PARAMETER;
+  }
+  //
+  // Address field shall be set on 32-bit boundary (Lower 2-bit is always set to 0)
+  // for 32-bit address descriptor table.
+  //
+  if ((Data & (BIT0 | BIT1)) != 0) {
+    DEBUG ((DEBUG_INFO, "The buffer [0x%x] to construct ADMA desc is not aligned to 4 bytes boundary!\n", Data));
+  }
+
+  Entries = DivU64x32 ((DataLen + ADMA_MAX_DATA_PER_LINE - 1), ADMA_MAX_DATA_PER_LINE);
+  if (Dma64) {
+    TableSize = (UINTN)MultU64x32 (Entries, sizeof (SD_MMC_HC_ADMA_64_DESC_LINE));
+  } else {
+    TableSize = (UINTN)MultU64x32 (Entries, sizeof (SD_MMC_HC_ADMA_DESC_LINE));
+  }
+
+  //
+  // Fall back to a table of its own when the pool is used up
+  //
+  Status = SdMmcHcAdmaPoolGet (Trb, TableSize);
+  if (EFI_ERROR (Status)) {
+    Status = SdMmcHcAdmaDescAllocate (Trb, TableSize);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  ZeroMem (Trb->AdmaDesc, TableSize);
+
+  AdmaDesc   = Trb->AdmaDesc;
+  AdmaDesc64 = Trb->AdmaDesc;
+  Remaining  = DataLen;
+  Address    = Data;
   for (Index = 0; Index < Entries; Index++) {
+    //
+    // Length of 0 stands for ADMA_MAX_DATA_PER_LINE bytes
+    //
     if (Remaining <= ADMA_MAX_DATA_PER_LINE) {
-      Trb->AdmaDesc[Index].Valid = 1;
-      Trb->AdmaDesc[Index].Act   = 2;
-      Trb->AdmaDesc[Index].Length  = (UINT16)Remaining;
-      Trb->AdmaDesc[Index].Address = Address;
-      break;
+      Length = (UINT16)Remaining;
+    } else {
+      Length = 0;
+    }
+
+    if (Dma64) {
+      AdmaDesc64[Index].Valid     = 1;
+      AdmaDesc64[Index].Act       = 2;
+      AdmaDesc64[Index].Length    = Length;
+      AdmaDesc64[Index].AddressLo = (UINT32)Address;
+      AdmaDesc64[Index].AddressHi = (UINT32)RShiftU64 (Address, 32);
     } else {
-      Trb->AdmaDesc[Index].Valid = 1;
-      Trb->AdmaDesc[Index].Act   = 2;
-      Trb->AdmaDesc[Index].Length  = 0;
-      Trb->AdmaDesc[Index].Address = Address;
+      AdmaDesc[Index].Valid   = 1;
+      AdmaDesc[Index].Act     = 2;
+      AdmaDesc[Index].Length  = Length;
+      AdmaDesc[Index].Address = (UINT32)Address;
+    }
+
+    if (Remaining <= ADMA_MAX_DATA_PER_LINE) {
+      break;
     }
 
     Remaining -= ADMA_MAX_DATA_PER_LINE;
@@ -1209,7 +1502,11 @@ BuildAdmaDescTable (
   //
   // Set the last descriptor line as end of descriptor table
   //
-  Trb->AdmaDesc[Index].End = 1;
+  if (Dma64) {
+    AdmaDesc64[Index].End = 1;
+  } else {
+    AdmaDesc[Index].End = 1;
+  }
   return EFI_SUCCESS;
 }
 
@@ -1252,8 +1549,8 @@ SdMmcCreateTrb (
   Trb->Packet    = Packet;
   Trb->Event     = Event;
   Trb->Started   = FALSE;
-  Trb->Timeout   = Packet->Timeout;
   Trb->Private   = Private;
+  Trb->SubmitTick = GetPerformanceCounter ();
 
   if ((Packet->InTransferLength != 0) && (Packet->InDataBuffer != NULL)) {
     Trb->Data    = Packet->InDataBuffer;
@@ -1310,6 +1607,7 @@ SdMmcCreateTrb (
       Status = BuildAdmaDescTable (Trb);
       if (EFI_ERROR (Status)) {
         PciIo->Unmap (PciIo, Trb->DataMap);
+        Trb->DataMap = NULL;
         goto Error;
       }
     } else if (Private->Capability[Slot].Sdma != 0) {
@@ -1344,21 +1642,28 @@ SdMmcFreeTrb (
   )
 {
   EFI_PCI_IO_PROTOCOL        *PciIo;
+  EFI_TPL                    OldTpl;
 
   PciIo = Trb->Private->PciIo;
 
-  if (Trb->AdmaMap != NULL) {
-    PciIo->Unmap (
-      PciIo,
-      Trb->AdmaMap
-    );
-  }
-  if (Trb->AdmaDesc != NULL) {
-    PciIo->FreeBuffer (
-      PciIo,
-      Trb->AdmaPages,
-      Trb->AdmaDesc
-    );
+  if (Trb->AdmaPooled) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    Trb->Private->AdmaPool[Trb->Slot].InUse[Trb->AdmaPoolIndex] = FALSE;
+    gBS->RestoreTPL (OldTpl);
+  } else {
+    if (Trb->AdmaMap != NULL) {
+      PciIo->Unmap (
+        PciIo,
+        Trb->AdmaMap
+      );
+    }
+    if (Trb->AdmaDesc != NULL) {
+      PciIo->FreeBuffer (
+        PciIo,
+        Trb->AdmaPages,
+        Trb->AdmaDesc
+      );
+    }
   }
   if (Trb->DataMap != NULL) {
     PciIo->Unmap (
@@ -1370,6 +1675,117 @@ SdMmcFreeTrb (
   return;
 }
 
+/**
+  Get the time elapsed since the specified performance counter value.
+
+  @param[in] StartTick      The performance counter value to measure from.
+
+  @return The elapsed time in nanoseconds.
+
+**/
+UINT64
+SdMmcGetElapsedTime (
+  IN UINT64                  StartTick
+  )
+{
+  UINT64                     Tick;
+  UINT64                     CounterStart;
+  UINT64                     CounterEnd;
+
+  Tick = GetPerformanceCounter ();
+  GetPerformanceCounterProperties (&CounterStart, &CounterEnd);
+
+  //
+  // The performance counter may count down.
+  //
+  if (CounterStart > CounterEnd) {
+    return GetTimeInNanoSecond (StartTick - Tick);
+  }
+  return GetTimeInNanoSecond (Tick - StartTick);
+}
+
+/**
+  Account the latency of a completed TRB to the statistics of its slot.
+
+  @param[in] Trb            The pointer to the SD_MMC_HC_TRB instance.
+  @param[in] Status         The completion status of the TRB.
+
+**/
+VOID
+SdMmcRecordLatency (
+  IN SD_MMC_HC_TRB           *Trb,
+  IN EFI_STATUS              Status
+  )
+{
+  SD_MMC_HC_LATENCY          *Latency;
+  UINT64                     Elapsed;
+  UINT64                     Micro;
+  INTN                       Bucket;
+  EFI_TPL                    OldTpl;
+
+  Elapsed = SdMmcGetElapsedTime (Trb->SubmitTick);
+  Micro   = DivU64x32 (Elapsed, 1000);
+  Bucket  = (Micro == 0) ? 0 : HighBitSet64 (Micro);
+  if (Bucket >= SD_MMC_HC_LATENCY_BUCKETS) {
+    Bucket = SD_MMC_HC_LATENCY_BUCKETS - 1;
+  }
+
+  OldTpl  = gBS->RaiseTPL (TPL_NOTIFY);
+  Latency = &Trb->Private->Latency[Trb->Slot];
+  if ((Latency->Count == 0) || (Elapsed < Latency->MinNs)) {
+    Latency->MinNs = Elapsed;
+  }
+  if (Elapsed > Latency->MaxNs) {
+    Latency->MaxNs = Elapsed;
+  }
+  Latency->TotalNs += Elapsed;
+  Latency->Count++;
+  if (EFI_ERROR (Status)) {
+    Latency->Errors++;
+  }
+  Latency->Histogram[Bucket]++;
+  gBS->RestoreTPL (OldTpl);
+}
+
+/**
+  Print the TRB latency statistics of all slots of the host controller.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+
+**/
+VOID
+SdMmcPrintLatency (
+  IN SD_MMC_HC_PRIVATE_DATA  *Private
+  )
+{
+  SD_MMC_HC_LATENCY          *Latency;
+  UINT8                      Slot;
+  UINTN                      Index;
+
+  for (Slot = 0; Slot < SD_MMC_HC_MAX_SLOT; Slot++) {
+    Latency = &Private->Latency[Slot];
+    if (Latency->Count == 0) {
+      continue;
+    }
+
+    DEBUG ((DEBUG_INFO, "SdMmcPciHc: slot %d %ld requests %ld errors, latency min %ldus avg %ldus max %ldus\n",
+      Slot,
+      Latency->Count,
+      Latency->Errors,
+      DivU64x32 (Latency->MinNs, 1000),
+      DivU64x64Remainder (Latency->TotalNs, MultU64x32 (Latency->Count, 1000), NULL),
+      DivU64x32 (Latency->MaxNs, 1000)));
+    for (Index = 0; Index < SD_MMC_HC_LATENCY_BUCKETS; Index++) {
+      if (Latency->Histogram[Index] != 0) {
+        DEBUG ((DEBUG_INFO, "  [%ldus, %ldus): %ld\n",
+          (Index == 0) ? 0 : LShiftU64 (1, Index),
+          LShiftU64 (1, Index + 1),
+          Latency->Histogram[Index]));
+      }
+    }
+  }
+}
+
 /**
   Check if the env is ready for execute specified TRB.
 
@@ -1475,6 +1891,61 @@ SdMmcWaitTrbEnv (
   return EFI_TIMEOUT;
 }
 
+/**
+  Send a deferred SET_BLOCK_COUNT command on its own and wait for its response.
+
+  @param[in] Private        A pointer to the SD_MMC_HC_PRIVATE_DATA instance.
+  @param[in] Slot           The slot number of the EMMC device.
+  @param[in] Argument       The argument of the SET_BLOCK_COUNT command.
+
+  @retval EFI_SUCCESS       The command is done correctly.
+  @retval Others            The command fails.
+
+**/
+STATIC
+EFI_STATUS
+SdMmcSendBlkCount (
+  IN SD_MMC_HC_PRIVATE_DATA           *Private,
+  IN UINT8                            Slot,
+  IN UINT32                           Argument
+  )
+{
+  EFI_SD_MMC_COMMAND_BLOCK            SdMmcCmdBlk;
+  EFI_SD_MMC_STATUS_BLOCK             SdMmcStatusBlk;
+  EFI_SD_MMC_PASS_THRU_COMMAND_PACKET Packet;
+  SD_MMC_HC_TRB                       *Trb;
+  EFI_STATUS                          Status;
+
+  ZeroMem (&SdMmcCmdBlk, sizeof (SdMmcCmdBlk));
+  ZeroMem (&SdMmcStatusBlk, sizeof (SdMmcStatusBlk));
+  ZeroMem (&Packet, sizeof (Packet));
+
+  Packet.SdMmcCmdBlk    = &SdMmcCmdBlk;
+  Packet.SdMmcStatusBlk = &SdMmcStatusBlk;
+  Packet.Timeout        = SD_MMC_HC_GENERIC_TIMEOUT;
+
+  SdMmcCmdBlk.CommandIndex    = EMMC_SET_BLOCK_COUNT;
+  SdMmcCmdBlk.CommandType     = SdMmcCommandTypeAc;
+  SdMmcCmdBlk.ResponseType    = SdMmcResponseTypeR1;
+  SdMmcCmdBlk.CommandArgument = Argument;
+
+  Trb = SdMmcCreateTrb (Private, Slot, &Packet, NULL);
+  if (Trb == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = SdMmcWaitTrbEnv (Private, Trb);
+  if (!EFI_ERROR (Status)) {
+    Status = SdMmcExecTrb (Private, Trb);
+  }
+  if (!EFI_ERROR (Status)) {
+    Status = SdMmcWaitTrbResult (Private, Trb);
+  }
+  SdMmcFreeTrb (Trb);
+
+  return Status;
+}
+
 /**
   Execute the specified TRB.
 
@@ -1503,9 +1974,53 @@ SdMmcExecTrb (
   UINT8                               HostCtrl1;
   UINT32                              SdmaAddr;
   UINT64                              AdmaAddr;
+  SD_MMC_BLK_COUNT_STATE              BlkCountState;
 
   Packet = Trb->Packet;
   PciIo  = Trb->Private->PciIo;
+
+  BlkCountState = Private->BlkCountState[Trb->Slot];
+  Private->BlkCountState[Trb->Slot] = SdMmcBlkCountNone;
+
+  if ((BlkCountState == SdMmcBlkCountDeferred) && (Trb->Mode != SdMmcAdmaMode)) {
+    //
+    // Auto CMD23 only goes out along with an ADMA data transfer. The deferred
+    // SET_BLOCK_COUNT was already reported done, so send it now on its own.
+    // The block count then stays pending on the card across commands without
+    // data, up to the next data transfer.
+    //
+    Private->BlkCountState[Trb->Slot] = SdMmcBlkCountSent;
+    Status = SdMmcSendBlkCount (Private, Trb->Slot, Private->BlkCountArg[Trb->Slot]);
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "SdMmcExecTrb: deferred SET_BLOCK_COUNT fails with %r\n", Status));
+      Private->BlkCountState[Trb->Slot] = SdMmcBlkCountNone;
+      return EFI_DEVICE_ERROR;
+    }
+    BlkCountState = SdMmcBlkCountSent;
+    if (Trb->Mode != SdMmcNoData) {
+      Private->BlkCountState[Trb->Slot] = SdMmcBlkCountNone;
+    }
+  }
+
+  if (Packet->SdMmcCmdBlk->CommandIndex == EMMC_SET_BLOCK_COUNT) {
+    //
+    // Host controllers compliant with version 3.00 can send SET_BLOCK_COUNT
+    // by themselves ahead of the data command, as long as the Argument 2
+    // register is not taken by SDMA. A command sent while a block count is
+    // still pending goes out on its own.
+    //
+    if ((BlkCountState == SdMmcBlkCountNone) &&
+        (Private->Slot[Trb->Slot].CardType == EmmcCardType) &&
+        ((Private->ControllerVersion & 0xFF) >= SDHCI_SPEC_300) &&
+        (Private->Capability[Trb->Slot].Adma2 != 0)) {
+      Private->BlkCountState[Trb->Slot] = SdMmcBlkCountDeferred;
+      Private->BlkCountArg[Trb->Slot]   = Packet->SdMmcCmdBlk->CommandArgument;
+      Trb->Deferred = TRUE;
+      return EFI_SUCCESS;
+    }
+    Private->BlkCountState[Trb->Slot] = SdMmcBlkCountSent;
+  }
+
   //
   // Clear all bits in Error Interrupt Status Register
   //
@@ -1526,7 +2041,19 @@ SdMmcExecTrb (
   // Set Host Control 1 register DMA Select field
   //
   if (Trb->Mode == SdMmcAdmaMode) {
-    HostCtrl1 = BIT4;
+    HostCtrl1 = (UINT8)~(BIT4 | BIT3);
+    Status = SdMmcHcAndMmio (PciIo, Trb->Slot, SD_MMC_HC_HOST_CTRL1, sizeof (HostCtrl1), &HostCtrl1);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+    //
+    // 32-bit ADMA2 or 64-bit ADMA2
+    //
+    if (Private->AdmaDma64[Trb->Slot]) {
+      HostCtrl1 = BIT4 | BIT3;
+    } else {
+      HostCtrl1 = BIT4;
+    }
     Status = SdMmcHcOrMmio (PciIo, Trb->Slot, SD_MMC_HC_HOST_CTRL1, sizeof (HostCtrl1), &HostCtrl1);
     if (EFI_ERROR (Status)) {
       return Status;
@@ -1553,6 +2080,17 @@ SdMmcExecTrb (
     }
   }
 
+  if (BlkCountState == SdMmcBlkCountDeferred) {
+    //
+    // Argument of Auto CMD23
+    //
+    Argument = Private->BlkCountArg[Trb->Slot];
+    Status   = SdMmcHcRwMmio (PciIo, Trb->Slot, SD_MMC_HC_ARG2, FALSE, sizeof (Argument), &Argument);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
   BlkSize = Trb->BlockSize;
   if (Trb->Mode == SdMmcSdmaMode) {
     //
@@ -1595,11 +2133,19 @@ SdMmcExecTrb (
     if (BlkCount > 1) {
       TransMode |= BIT5 | BIT1;
     }
-    //
-    // Only SD memory card needs to use AUTO CMD12 feature.
-    //
-    if (Private->Slot[Trb->Slot].CardType == SdCardType) {
-      if (BlkCount > 1) {
+    if (BlkCountState == SdMmcBlkCountDeferred) {
+      //
+      // Auto CMD23 Enable, the card stops the transfer by itself.
+      //
+      TransMode |= BIT5 | BIT3 | BIT1;
+    } else if ((BlkCountState == SdMmcBlkCountNone) && (BlkCount > 1) && !Trb->CmdqTask) {
+      //
+      // Auto CMD12 Enable for open-ended transfers, so no separate
+      // STOP_TRANSMISSION command is needed. Command queue tasks have
+      // their block count set when queued.
+      //
+      if ((Private->Slot[Trb->Slot].CardType == SdCardType) ||
+          (Private->Slot[Trb->Slot].CardType == EmmcCardType)) {
         TransMode |= BIT2;
       }
     }
@@ -1672,10 +2218,20 @@ SdMmcCheckTrbResult (
   UINT32                              SdmaAddr;
   UINT8                               Index;
   UINT8                               SwReset;
-  UINT32                              PioLength;
+  UINT16                              AutoCmdErr;
 
   SwReset = 0;
   Packet  = Trb->Packet;
+
+  if (Trb->Deferred) {
+    //
+    // SET_BLOCK_COUNT goes out as Auto CMD23 of the next data transfer,
+    // errors are reported by that transfer.
+    //
+    ZeroMem (Packet->SdMmcStatusBlk, sizeof (EFI_SD_MMC_STATUS_BLOCK));
+    Packet->SdMmcStatusBlk->Resp0 = SD_MMC_HC_DEFERRED_CMD23_STATUS;
+    return EFI_SUCCESS;
+  }
   //
   // Check Trb execution result by reading Normal Interrupt Status register.
   //
@@ -1743,6 +2299,21 @@ SdMmcCheckTrbResult (
     if ((IntStatus & 0xF0) != 0) {
       SwReset |= BIT2;
     }
+    if ((IntStatus & BIT8) != 0) {
+      //
+      // Auto CMD12 or Auto CMD23 failed
+      //
+      SdMmcHcRwMmio (
+        Private->PciIo,
+        Trb->Slot,
+        SD_MMC_HC_AUTO_CMD_ERR_STS,
+        TRUE,
+        sizeof (AutoCmdErr),
+        &AutoCmdErr
+        );
+      DEBUG ((DEBUG_ERROR, "SdMmcCheckTrbResult: Auto CMD error 0x%x\n", AutoCmdErr));
+      SwReset |= BIT1;
+    }
 
     Status  = SdMmcHcRwMmio (
                 Private->PciIo,
@@ -1817,27 +2388,42 @@ SdMmcCheckTrbResult (
     }
   }
 
-  if (((Private->Slot[Trb->Slot].CardType == EmmcCardType) &&
-       (Packet->SdMmcCmdBlk->CommandIndex == EMMC_SEND_TUNING_BLOCK)) ||
-      ((Private->Slot[Trb->Slot].CardType == SdCardType) &&
-       (Packet->SdMmcCmdBlk->CommandIndex == SD_SEND_TUNING_BLOCK))) {
+  if ((Trb->Mode == SdMmcPioMode) && (Trb->DataLen != 0)) {
     //
-    // When performing tuning procedure (Execute Tuning is set to 1) through PIO mode,
-    // wait Buffer Read Ready bit of Normal Interrupt Status Register to be 1.
-    // Refer to SD Host Controller Simplified Specification 3.0 figure 2-29 for details.
+    // Wait Buffer Read Ready or Buffer Write Ready bit of Normal Interrupt
+    // Status Register to be 1, then move all blocks the buffer holds.
     //
-    if ((IntStatus & BIT5) == BIT5) {
+    if ((IntStatus & (BIT4 | BIT5)) != 0) {
       //
-      // Clear Buffer Read Ready interrupt at first.
+      // Clear Buffer Read/Write Ready interrupt at first.
       //
-      IntStatus = BIT5;
+      IntStatus &= BIT4 | BIT5;
       SdMmcHcRwMmio (Private->PciIo, Trb->Slot, SD_MMC_HC_NOR_INT_STS, FALSE, sizeof (IntStatus), &IntStatus);
-      //
-      // Read data out from Buffer Port register
-      //
-      for (PioLength = 0; PioLength < Trb->DataLen; PioLength += 4) {
-        SdMmcHcRwMmio (Private->PciIo, Trb->Slot, SD_MMC_HC_BUF_DAT_PORT, TRUE, 4, (UINT8*)Trb->Data + PioLength);
+
+      Status = SdMmcHcPioTransfer (
+                 Private->PciIo,
+                 Trb->Slot,
+                 Trb->Read,
+                 Trb->BlockSize,
+                 Trb->Data,
+                 Trb->DataLen,
+                 &Trb->PioLength
+                 );
+      if (EFI_ERROR (Status)) {
+        goto Done;
       }
+    }
+
+    //
+    // When performing tuning procedure (Execute Tuning is set to 1) through PIO mode,
+    // the tuning block ends with Buffer Read Ready and no Transfer Complete follows.
+    // Refer to SD Host Controller Simplified Specification 3.0 figure 2-29 for details.
+    //
+    if ((((Private->Slot[Trb->Slot].CardType == EmmcCardType) &&
+          (Packet->SdMmcCmdBlk->CommandIndex == EMMC_SEND_TUNING_BLOCK)) ||
+         ((Private->Slot[Trb->Slot].CardType == SdCardType) &&
+          (Packet->SdMmcCmdBlk->CommandIndex == SD_SEND_TUNING_BLOCK))) &&
+        (Trb->PioLength == Trb->DataLen)) {
       Status = EFI_SUCCESS;
       goto Done;
     }
@@ -1895,6 +2481,8 @@ SdMmcWaitTrbResult (
   EFI_SD_MMC_PASS_THRU_COMMAND_PACKET *Packet;
   UINT64                              Timeout;
   BOOLEAN                             InfiniteWait;
+  UINT32                              Spin;
+  UINTN                               Stall;
 
   Packet = Trb->Packet;
   //
@@ -1907,6 +2495,13 @@ SdMmcWaitTrbResult (
     InfiniteWait = FALSE;
   }
 
+  //
+  // Short transfers usually complete within a few register reads, poll them
+  // back to back at first. Then back off, doubling the stall between two polls.
+  //
+  Spin  = (Trb->DataLen <= SD_MMC_HC_POLL_SHORT_LEN) ? SD_MMC_HC_POLL_SPIN : 0;
+  Stall = 0;
+
   while (InfiniteWait || (Timeout > 0)) {
     //
     // Check Trb execution result by reading Normal Interrupt Status register.
@@ -1915,12 +2510,19 @@ SdMmcWaitTrbResult (
     if (Status != EFI_NOT_READY) {
       return Status;
     }
-    //
-    // Stall for 1 microsecond.
-    //
-    gBS->Stall (1);
 
-    Timeout--;
+    if (Spin > 0) {
+      Spin--;
+      continue;
+    }
+
+    Stall = (Stall == 0) ? 1 : MIN (Stall * 2, SD_MMC_HC_POLL_MAX_STALL);
+    if (!InfiniteWait && (Stall > Timeout)) {
+      Stall = (UINTN)Timeout;
+    }
+    gBS->Stall (Stall);
+
+    Timeout -= Stall;
   }
 
   return EFI_TIMEOUT;
@@ -62,6 +62,12 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #define SD_MMC_HC_SLOT_INT_STS        0xFC
 #define SD_MMC_HC_CTRL_VER            0xFE
 
+//
+// Card status reported for a SET_BLOCK_COUNT command left to Auto CMD23:
+// READY_FOR_DATA set and CURRENT_STATE equal to tran.
+//
+#define SD_MMC_HC_DEFERRED_CMD23_STATUS  (BIT8 | (4 << 9))
+
 //
 // The transfer modes supported by SD Host Controller
 // Simplified Spec 3.0 Table 1-2
@@ -73,6 +79,15 @@ typedef enum {
   SdMmcAdmaMode
 } SD_MMC_HC_TRANSFER_MODE;
 
+//
+// State of the SET_BLOCK_COUNT command ahead of the next data transfer on a slot
+//
+typedef enum {
+  SdMmcBlkCountNone,
+  SdMmcBlkCountSent,
+  SdMmcBlkCountDeferred
+} SD_MMC_BLK_COUNT_STATE;
+
 //
 // The maximum data length of each descriptor line
 //
@@ -89,6 +104,39 @@ typedef struct {
   UINT32 Address;
 } SD_MMC_HC_ADMA_DESC_LINE;
 
+//
+// 96-bit descriptor line of 64-bit ADMA2
+//
+typedef struct {
+  UINT32 Valid:1;
+  UINT32 End:1;
+  UINT32 Int:1;
+  UINT32 Reserved:1;
+  UINT32 Act:2;
+  UINT32 Reserved1:10;
+  UINT32 Length:16;
+  UINT32 AddressLo;
+  UINT32 AddressHi;
+} SD_MMC_HC_ADMA_64_DESC_LINE;
+
+//
+// Descriptor tables allocated and mapped once per slot, and reused by TRBs.
+// Each table covers the largest transfer the Block Count register allows,
+// 0xFFFF blocks of 512 bytes.
+//
+#define SD_MMC_HC_ADMA_POOL_TABLES    4
+#define SD_MMC_HC_ADMA_POOL_LINES     ((0xFFFF * 0x200 + ADMA_MAX_DATA_PER_LINE - 1) / ADMA_MAX_DATA_PER_LINE)
+#define SD_MMC_HC_ADMA_POOL_TABLE_SIZE \
+          (SD_MMC_HC_ADMA_POOL_LINES * sizeof (SD_MMC_HC_ADMA_64_DESC_LINE))
+
+typedef struct {
+  UINT8                  *Desc;
+  EFI_PHYSICAL_ADDRESS   DescPhy;
+  VOID                   *Map;
+  UINT32                 Pages;
+  BOOLEAN                InUse[SD_MMC_HC_ADMA_POOL_TABLES];
+} SD_MMC_HC_ADMA_POOL;
+
 #define SD_MMC_SDMA_BOUNDARY          512 * 1024
 #define SD_MMC_SDMA_ROUND_UP(x, n)    (((x) + n) & ~(n - 1))
 
@@ -299,6 +347,37 @@ SdMmcHcWaitMmioSet (
   IN  UINT64                    Timeout
   );
 
+/**
+  Move data blocks through the Buffer Data Port of the specified slot.
+
+  Whole blocks are moved with 32-bit FIFO accesses for as long as the Present
+  State register reports the buffer ready, so a single Buffer Read/Write Ready
+  event may move several blocks.
+
+  @param[in]      PciIo         The PCI IO protocol instance.
+  @param[in]      Slot          The slot number of the SD card.
+  @param[in]      Read          TRUE to read data from the card.
+  @param[in]      BlockSize     The size of a data block in bytes, a multiple of 4.
+  @param[in, out] Data          The data buffer of the transfer.
+  @param[in]      DataLen       The length of the whole transfer in bytes.
+  @param[in, out] Offset        The number of bytes already moved, updated on
+                                return.
+
+  @retval EFI_SUCCESS           All blocks available in the buffer are moved.
+  @retval Others                The Buffer Data Port access fails.
+
+**/
+EFI_STATUS
+SdMmcHcPioTransfer (
+  IN     EFI_PCI_IO_PROTOCOL  *PciIo,
+  IN     UINT8                Slot,
+  IN     BOOLEAN              Read,
+  IN     UINT16               BlockSize,
+  IN OUT UINT8                *Data,
+  IN     UINT32               DataLen,
+  IN OUT UINT32               *Offset
+  );
+
 /**
   Software reset the specified SD/MMC host controller.
 
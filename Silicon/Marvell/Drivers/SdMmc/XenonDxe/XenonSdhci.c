@@ -502,114 +502,6 @@ XenonReset (
   }
 }
 
-STATIC
-VOID
-XenonTransferPio (
-  IN SD_MMC_HC_PRIVATE_DATA *Private,
-  IN UINT8 Slot,
-  IN OUT VOID *Buffer,
-  IN UINT16 BlockSize,
-  IN BOOLEAN Read
-  )
-{
-  UINTN Index;
-  UINT8 *Offs;
-
-  //
-  // SD stack's intrinsic functions cannot perform properly reading/writing from
-  // buffer register, that is why MmioRead/MmioWrite are used. It is temporary
-  // solution.
-  //
-  for (Index = 0; Index < BlockSize; Index += 4) {
-    Offs = Buffer + Index;
-    if (Read) {
-      *(UINT32 *)Offs = MmioRead32 (SDHC_DAT_BUF_PORT_ADDR);
-    } else {
-      MmioWrite32 (SDHC_DAT_BUF_PORT_ADDR, *(UINT32 *)Offs);
-    }
-  }
-}
-
-EFI_STATUS
-XenonTransferData (
-  IN SD_MMC_HC_PRIVATE_DATA *Private,
-  IN UINT8 Slot,
-  IN OUT VOID *Buffer,
-  IN UINT32 DataLen,
-  IN UINT16 BlockSize,
-  IN UINT16 Blocks,
-  IN BOOLEAN Read
-  )
-{
-  UINT32 IntStatus, PresentState, Rdy, Mask, Retry, Block = 0;
-
-  if (Buffer == NULL) {
-    return EFI_DEVICE_ERROR;
-  }
-
-  Retry = SDHC_INT_STATUS_POLL_RETRY_DATA_TRAN;
-  Rdy = NOR_INT_STS_TX_RDY | NOR_INT_STS_RX_RDY;
-  Mask = PRESENT_STATE_BUFFER_RD_EN | PRESENT_STATE_BUFFER_WR_EN;
-
-  do {
-    SdMmcHcRwMmio (
-            Private->PciIo,
-            Slot,
-            SD_MMC_HC_NOR_INT_STS,
-            TRUE,
-            sizeof (IntStatus),
-            &IntStatus
-          );
-
-    if (IntStatus & NOR_INT_STS_ERR_INT) {
-      DEBUG((DEBUG_INFO, "SD/MMC: Error detected in status %0x\n", IntStatus));
-      return EFI_DEVICE_ERROR;
-    }
-
-    if (IntStatus & Rdy) {
-      SdMmcHcRwMmio (
-              Private->PciIo,
-              Slot,
-              SD_MMC_HC_PRESENT_STATE,
-              TRUE,
-              sizeof (PresentState),
-              &PresentState
-            );
-
-      if (!(PresentState & Mask)) {
-        continue;
-      }
-
-      SdMmcHcRwMmio (
-              Private->PciIo,
-              Slot,
-              SD_MMC_HC_NOR_INT_STS,
-              FALSE,
-              sizeof (Rdy),
-              &Rdy
-            );
-
-      XenonTransferPio (Private, Slot, Buffer, BlockSize, Read);
-
-      Buffer += BlockSize;
-      if (++Block >= Blocks) {
-        break;
-      }
-    }
-
-    if (Retry-- > 0) {
-
-      // Poll interval for data transfer complete bit in NOR_INT_STS register is 10us
-      gBS->Stall (10);
-    } else {
-      DEBUG((DEBUG_INFO, "SD/MMC: Transfer data timeout\n"));
-      return EFI_TIMEOUT;
-    }
-  } while (!(IntStatus & NOR_INT_STS_XFER_COMPLETE));
-
-  return EFI_SUCCESS;
-}
-
 EFI_STATUS
 XenonInit (
   IN SD_MMC_HC_PRIVATE_DATA *Private
@@ -118,8 +118,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define SDHC_REG_SIZE_2B              2
 #define SDHC_REG_SIZE_4B              4
 
-#define SDHC_DAT_BUF_PORT_ADDR        0xF06E0020
-
 /* Command register bits description */
 #define RESP_TYPE_136_BITS            (1 << 0)
 #define RESP_TYPE_48_BITS             (1 << 1)
@@ -233,7 +231,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 /* Max retry count for INT status ready */
 #define SDHC_INT_STATUS_POLL_RETRY              1000
-#define SDHC_INT_STATUS_POLL_RETRY_DATA_TRAN    100000
+#define SDHC_INT_STATUS_POLL_RETRY_DATA_TRAN    1000000
 
 /* Take 2.5 seconds as generic time out value, 1 microsecond as unit */
 #define SD_GENERIC_TIMEOUT            2500 * 1000
@@ -321,17 +319,6 @@ XenonReset (
   IN UINT8 Mask
   );
 
-EFI_STATUS
-XenonTransferData (
-  IN SD_MMC_HC_PRIVATE_DATA *Private,
-  IN UINT8 Slot,
-  IN OUT VOID *Buffer,
-  IN UINT32 DataLen,
-  IN UINT16 BlockSize,
-  IN UINT16 Blocks,
-  IN BOOLEAN Read
-  );
-
 EFI_STATUS
 XenonInit (
   IN SD_MMC_HC_PRIVATE_DATA *Private
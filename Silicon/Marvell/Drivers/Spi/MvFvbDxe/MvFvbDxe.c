@@ -57,6 +57,7 @@ STATIC CONST FVB_DEVICE mMvFvbFlashInstanceTemplate = {
   0, // FvbOffset ... NEED TO BE FILLED
   0, // FvbSize ... NEED TO BE FILLED
   0, // StartLba
+  NULL, // ShadowBuffer ... NEED TO BE FILLED
 
   {
     0,     // MediaId ... NEED TO BE FILLED
@@ -229,7 +230,7 @@ MvFvbValidateFvHeader (
   VARIABLE_STORE_HEADER       *VariableStoreHeader;
   UINTN                       VariableStoreLength;
 
-  FwVolHeader = (EFI_FIRMWARE_VOLUME_HEADER *)FlashInstance->RegionBaseAddress;
+  FwVolHeader = (EFI_FIRMWARE_VOLUME_HEADER *)FlashInstance->ShadowBuffer;
 
   // Verify the header revision, header signature, length
   if ((FwVolHeader->Revision  != EFI_FVH_REVISION) ||
@@ -283,6 +284,40 @@ MvFvbValidateFvHeader (
   return EFI_SUCCESS;
 }
 
+/**
+  Locate a range of the firmware volume in its RAM shadow.
+
+  @param[in] FlashInstance  The FVB device.
+  @param[in] Lba            The logical block of the range.
+  @param[in] Offset         Offset of the range within the block.
+  @param[in] NumBytes       Length of the range.
+
+  @return  Pointer to the shadowed range, or NULL if it is not shadowed.
+
+**/
+STATIC
+UINT8 *
+MvFvbGetShadow (
+  IN FVB_DEVICE *FlashInstance,
+  IN EFI_LBA     Lba,
+  IN UINTN       Offset,
+  IN UINTN       NumBytes
+  )
+{
+  UINTN ShadowOffset;
+
+  ShadowOffset = GET_DATA_OFFSET (Offset,
+                   FlashInstance->StartLba + Lba,
+                   FlashInstance->Media.BlockSize);
+
+  if (ShadowOffset >= FlashInstance->FvbSize ||
+      NumBytes > FlashInstance->FvbSize - ShadowOffset) {
+    return NULL;
+  }
+
+  return FlashInstance->ShadowBuffer + ShadowOffset;
+}
+
 /**
  The GetAttributes() function retrieves the attributes and
  current settings of the block.
@@ -310,7 +345,7 @@ MvFvbGetAttributes (
 
   FlashInstance = INSTANCE_FROM_FVB_THIS (This);
 
-  FwVolHeader = (EFI_FIRMWARE_VOLUME_HEADER *)FlashInstance->RegionBaseAddress;
+  FwVolHeader = (EFI_FIRMWARE_VOLUME_HEADER *)FlashInstance->ShadowBuffer;
   FlashFvbAttributes = (EFI_FVB_ATTRIBUTES_2 *)&(FwVolHeader->Attributes);
 
   *Attributes = *FlashFvbAttributes;
@@ -584,6 +619,7 @@ MvFvbRead (
   FVB_DEVICE   *FlashInstance;
   UINTN         BlockSize;
   UINTN         DataOffset;
+  UINT8        *Shadow;
 
   FlashInstance = INSTANCE_FROM_FVB_THIS (This);
 
@@ -613,6 +649,13 @@ MvFvbRead (
     return EFI_SUCCESS;
   }
 
+  // Serve the variable store from its RAM shadow
+  Shadow = MvFvbGetShadow (FlashInstance, Lba, Offset, *NumBytes);
+  if (Shadow != NULL) {
+    CopyMem (Buffer, Shadow, *NumBytes);
+    return EFI_SUCCESS;
+  }
+
   DataOffset = GET_DATA_OFFSET (FlashInstance->RegionBaseAddress + Offset,
                  FlashInstance->StartLba + Lba,
                  FlashInstance->Media.BlockSize);
@@ -692,7 +735,12 @@ MvFvbWrite (
   )
 {
   FVB_DEVICE   *FlashInstance;
+  EFI_STATUS    Status;
   UINTN         DataOffset;
+  UINTN         Start;
+  UINTN         End;
+  UINTN         Index;
+  UINT8        *Shadow;
 
   FlashInstance = INSTANCE_FROM_FVB_THIS (This);
 
@@ -700,10 +748,56 @@ MvFvbWrite (
                  FlashInstance->StartLba + Lba,
                  FlashInstance->Media.BlockSize);
 
-  return FlashInstance->SpiFlashProtocol->Write (&FlashInstance->SpiDevice,
-                                            DataOffset,
-                                            *NumBytes,
-                                            Buffer);
+  Shadow = MvFvbGetShadow (FlashInstance, Lba, Offset, *NumBytes);
+  if (Shadow == NULL) {
+    return FlashInstance->SpiFlashProtocol->Write (&FlashInstance->SpiDevice,
+                                              DataOffset,
+                                              *NumBytes,
+                                              Buffer);
+  }
+
+  //
+  // Refresh the range from the memory-mapped flash first, so the comparison
+  // below is against what is really stored, even if the flash was written
+  // behind this driver's back.
+  //
+  CopyMem (Shadow,
+    (VOID *)GET_DATA_OFFSET (FlashInstance->RegionBaseAddress + Offset,
+              FlashInstance->StartLba + Lba,
+              FlashInstance->Media.BlockSize),
+    *NumBytes);
+
+  //
+  // Only program the span that differs from the current contents. Callers
+  // often rewrite a whole header to change a single state byte.
+  //
+  Start = 0;
+  End = *NumBytes;
+  while (Start < End && Shadow[Start] == Buffer[Start]) {
+    Start++;
+  }
+  while (End > Start && Shadow[End - 1] == Buffer[End - 1]) {
+    End--;
+  }
+
+  if (Start == End) {
+    return EFI_SUCCESS;
+  }
+
+  Status = FlashInstance->SpiFlashProtocol->Write (&FlashInstance->SpiDevice,
+                                              DataOffset + Start,
+                                              End - Start,
+                                              &Buffer[Start]);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  // Programming can only clear bits, keep the shadow equal to the flash
+  for (Index = Start; Index < End; Index++) {
+    Shadow[Index] &= Buffer[Index];
+  }
+
+  return EFI_SUCCESS;
 }
 
 /**
@@ -766,6 +860,7 @@ MvFvbEraseBlocks (
   UINTN                  BlockAddress; // Physical address of Lba to erase
   EFI_LBA                StartingLba;  // Lba from which we start erasing
   UINTN                  NumOfLba;     // Number of Lba blocks to erase
+  UINT8                 *Shadow;
 
   FlashInstance = INSTANCE_FROM_FVB_THIS (This);
 
@@ -849,6 +944,14 @@ MvFvbEraseBlocks (
         return EFI_DEVICE_ERROR;
       }
 
+      Shadow = MvFvbGetShadow (FlashInstance,
+                 StartingLba,
+                 0,
+                 FlashInstance->Media.BlockSize);
+      if (Shadow != NULL) {
+        SetMem (Shadow, FlashInstance->Media.BlockSize, 0xFF);
+      }
+
       // Move to the next Lba
       StartingLba++;
       NumOfLba--;
@@ -875,8 +978,9 @@ MvFvbVirtualNotifyEvent (
   IN VOID             *Context
   )
 {
-  // Convert SPI memory mapped region
+  // Convert SPI memory mapped region and its shadow
   EfiConvertPointer (0x0, (VOID**)&mFvbDevice->RegionBaseAddress);
+  EfiConvertPointer (0x0, (VOID**)&mFvbDevice->ShadowBuffer);
 
   // Convert SPI device description
   EfiConvertPointer (0x0, (VOID**)&mFvbDevice->SpiDevice.Info);
@@ -956,6 +1060,7 @@ MvFvbPrepareFvHeader (
     if (EFI_ERROR (Status)) {
       return Status;
     }
+    SetMem (FlashInstance->ShadowBuffer, FlashInstance->FvbSize, 0xFF);
 
     // Install all appropriate headers
     Status = MvFvbInitFvAndVariableStoreHeaders (FlashInstance);
@@ -1021,12 +1126,26 @@ MvFvbConfigureFlashInstance (
   FlashInstance->Media.LastBlock = FlashInstance->Size /
                                    FlashInstance->Media.BlockSize - 1;
 
+  //
+  // Keep a RAM copy of the whole region. Reads are served from it and
+  // writes go through to the flash. Reads assume this driver is the only
+  // writer of the region while it runs: an image written through the SPI
+  // flash protocol directly (e.g. by the fupdate shell command) is only
+  // seen after a reset. Writes re-read the affected range before use.
+  //
+  FlashInstance->ShadowBuffer = AllocateRuntimeCopyPool (FlashInstance->FvbSize,
+                                  (VOID *)FlashInstance->RegionBaseAddress);
+  if (FlashInstance->ShadowBuffer == NULL) {
+    DEBUG ((DEBUG_ERROR, "%a: Cannot allocate shadow buffer\n", __FUNCTION__));
+    return EFI_OUT_OF_RESOURCES;
+  }
+
   Status = gBS->InstallMultipleProtocolInterfaces (&FlashInstance->Handle,
                   &gEfiDevicePathProtocolGuid, &FlashInstance->DevicePath,
                   &gEfiFirmwareVolumeBlockProtocolGuid, &FlashInstance->FvbProtocol,
                   NULL);
   if (EFI_ERROR (Status)) {
-    return Status;
+    goto ErrorInstallProtocols;
   }
 
   Status = MvFvbPrepareFvHeader (FlashInstance);
@@ -1042,6 +1161,9 @@ ErrorPrepareFvbHeader:
          &gEfiFirmwareVolumeBlockProtocolGuid,
          NULL);
 
+ErrorInstallProtocols:
+  FreePool (FlashInstance->ShadowBuffer);
+
   return Status;
 }
 
@@ -1130,6 +1252,7 @@ ErrorAddSpace:
          &gEfiDevicePathProtocolGuid,
          &gEfiFirmwareVolumeBlockProtocolGuid,
          NULL);
+  FreePool (mFvbDevice->ShadowBuffer);
 
 ErrorConfigureFlash:
   FreePool (mFvbDevice);
@@ -61,6 +61,7 @@ typedef struct {
   UINTN                               FvbOffset;
   UINTN                               FvbSize;
   EFI_LBA                             StartLba;
+  UINT8                               *ShadowBuffer;
 
   EFI_BLOCK_IO_MEDIA                  Media;
   EFI_FIRMWARE_VOLUME_BLOCK2_PROTOCOL FvbProtocol;
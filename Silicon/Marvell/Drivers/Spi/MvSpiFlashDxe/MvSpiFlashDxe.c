@@ -175,29 +175,47 @@ SpiFlashBank (
   return BankSel;
 }
 
-EFI_STATUS
-MvSpiFlashErase (
+STATIC
+UINTN
+MvSpiFlashGetEraseSize (
   IN SPI_DEVICE *Slave,
-  IN UINTN Offset,
-  IN UINTN Length
+  OUT UINT8     *EraseCmd OPTIONAL
   )
 {
-  EFI_STATUS Status;
-  UINT32 EraseAddr;
+  UINT8 Cmd;
   UINTN EraseSize;
-  UINT8 Cmd[5];
 
   if (Slave->Info->Flags & NOR_FLASH_ERASE_4K) {
-    Cmd[0] = CMD_ERASE_4K;
+    Cmd = CMD_ERASE_4K;
     EraseSize = SIZE_4KB;
   } else if (Slave->Info->Flags & NOR_FLASH_ERASE_32K) {
-    Cmd[0] = CMD_ERASE_32K;
+    Cmd = CMD_ERASE_32K;
     EraseSize = SIZE_32KB;
   } else {
-    Cmd[0] = CMD_ERASE_64K;
+    Cmd = CMD_ERASE_64K;
     EraseSize = Slave->Info->SectorSize;
   }
 
+  if (EraseCmd != NULL) {
+    *EraseCmd = Cmd;
+  }
+  return EraseSize;
+}
+
+EFI_STATUS
+MvSpiFlashErase (
+  IN SPI_DEVICE *Slave,
+  IN UINTN Offset,
+  IN UINTN Length
+  )
+{
+  EFI_STATUS Status;
+  UINT32 EraseAddr;
+  UINTN EraseSize;
+  UINT8 Cmd[5];
+
+  EraseSize = MvSpiFlashGetEraseSize (Slave, &Cmd[0]);
+
   // Check input parameters
   if (Offset % EraseSize || Length % EraseSize) {
     DEBUG((DEBUG_ERROR, "SpiFlash: Either erase offset or length "
@@ -307,6 +325,60 @@ MvSpiFlashWrite (
   return EFI_SUCCESS;
 }
 
+STATIC
+BOOLEAN
+MvSpiFlashIsErased (
+  IN UINT8 *Buf,
+  IN UINTN Length
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < Length; Index++) {
+    if (Buf[Index] != 0xff) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+//
+// Program Buf page by page. With Old, pages matching the current contents
+// are skipped; without it the area is freshly erased and all-0xff pages are.
+//
+STATIC
+EFI_STATUS
+MvSpiFlashWritePages (
+  IN SPI_DEVICE *Slave,
+  IN UINT32 Offset,
+  IN UINTN Length,
+  IN UINT8 *Buf,
+  IN UINT8 *Old
+  )
+{
+  EFI_STATUS Status;
+  UINTN Index, ChunkLength, PageSize;
+
+  PageSize = Slave->Info->PageSize;
+
+  for (Index = 0; Index < Length; Index += ChunkLength) {
+    ChunkLength = MIN (Length - Index, PageSize - ((Offset + Index) % PageSize));
+    if (Old != NULL) {
+      if (CompareMem (&Buf[Index], &Old[Index], ChunkLength) == 0) {
+        continue;
+      }
+    } else if (MvSpiFlashIsErased (&Buf[Index], ChunkLength)) {
+      continue;
+    }
+
+    Status = MvSpiFlashWrite (Slave, Offset + Index, ChunkLength, &Buf[Index]);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
 STATIC
 EFI_STATUS
 MvSpiFlashUpdateBlock (
@@ -315,10 +387,12 @@ MvSpiFlashUpdateBlock (
   IN UINTN ToUpdate,
   IN UINT8 *Buf,
   IN UINT8 *TmpBuf,
-  IN UINTN EraseSize
+  IN UINTN EraseSize,
+  OUT SPI_FLASH_UPDATE_ACTION *Action
   )
 {
   EFI_STATUS Status;
+  UINTN Index;
 
   // Read backup
   Status = MvSpiFlashRead (Slave, Offset, EraseSize, TmpBuf);
@@ -327,6 +401,29 @@ MvSpiFlashUpdateBlock (
       return Status;
     }
 
+  // Leave the sector alone if it already holds the new data
+  if (CompareMem (TmpBuf, Buf, ToUpdate) == 0) {
+    *Action = SPI_FLASH_UPDATE_SKIPPED;
+    return EFI_SUCCESS;
+  }
+
+  // Programming can only clear bits, so erase only if some bit must be set
+  for (Index = 0; Index < ToUpdate; Index++) {
+    if ((TmpBuf[Index] & Buf[Index]) != Buf[Index]) {
+      break;
+    }
+  }
+
+  if (Index == ToUpdate) {
+    Status = MvSpiFlashWritePages (Slave, Offset, ToUpdate, Buf, TmpBuf);
+    if (EFI_ERROR (Status)) {
+      DEBUG((DEBUG_ERROR, "SpiFlash: Update: Error while writing new data\n"));
+      return Status;
+    }
+    *Action = SPI_FLASH_UPDATE_PROGRAMMED;
+    return EFI_SUCCESS;
+  }
+
   // Erase entire sector
   Status = MvSpiFlashErase (Slave, Offset, EraseSize);
   if (EFI_ERROR (Status)) {
@@ -334,8 +431,8 @@ MvSpiFlashUpdateBlock (
       return Status;
     }
 
-  // Write new data
-  MvSpiFlashWrite (Slave, Offset, ToUpdate, Buf);
+  // Write new data, pages left erased need no programming
+  Status = MvSpiFlashWritePages (Slave, Offset, ToUpdate, Buf, NULL);
   if (EFI_ERROR (Status)) {
       DEBUG((DEBUG_ERROR, "SpiFlash: Update: Error while writing new data\n"));
       return Status;
@@ -343,14 +440,15 @@ MvSpiFlashUpdateBlock (
 
   // Write backup
   if (ToUpdate != EraseSize) {
-    Status = MvSpiFlashWrite (Slave, Offset + ToUpdate, EraseSize - ToUpdate,
-      &TmpBuf[ToUpdate]);
+    Status = MvSpiFlashWritePages (Slave, Offset + ToUpdate, EraseSize - ToUpdate,
+      &TmpBuf[ToUpdate], NULL);
     if (EFI_ERROR (Status)) {
       DEBUG((DEBUG_ERROR, "SpiFlash: Update: Error while writing backup\n"));
       return Status;
     }
   }
 
+  *Action = SPI_FLASH_UPDATE_ERASED;
   return EFI_SUCCESS;
 }
 
@@ -365,8 +463,12 @@ MvSpiFlashUpdate (
   EFI_STATUS Status;
   UINT64 SectorSize, ToUpdate, Scale = 1;
   UINT8 *TmpBuf, *End;
+  SPI_FLASH_UPDATE_ACTION Action;
+  UINTN Count[SPI_FLASH_UPDATE_ACTION_MAX];
 
-  SectorSize = Slave->Info->SectorSize;
+  // Compare and erase in the smallest unit the part can erase
+  SectorSize = MvSpiFlashGetEraseSize (Slave, NULL);
+  ZeroMem (Count, sizeof (Count));
 
   End = Buf + ByteCount;
 
@@ -382,15 +484,21 @@ MvSpiFlashUpdate (
   for (; Buf < End; Buf += ToUpdate, Offset += ToUpdate) {
     ToUpdate = MIN((UINT64)(End - Buf), SectorSize);
     Print (L"   \rUpdating, %d%%", 100 - (End - Buf) / Scale);
-    Status = MvSpiFlashUpdateBlock (Slave, Offset, ToUpdate, Buf, TmpBuf, SectorSize);
+    Status = MvSpiFlashUpdateBlock (Slave, Offset, ToUpdate, Buf, TmpBuf,
+               SectorSize, &Action);
 
     if (EFI_ERROR (Status)) {
       DEBUG((DEBUG_ERROR, "SpiFlash: Error while updating\n"));
+      FreePool (TmpBuf);
       return Status;
     }
+    Count[Action]++;
   }
 
   Print(L"\n");
+  Print(L"%d sectors unchanged, %d programmed without erase, %d erased\n",
+    Count[SPI_FLASH_UPDATE_SKIPPED], Count[SPI_FLASH_UPDATE_PROGRAMMED],
+    Count[SPI_FLASH_UPDATE_ERASED]);
   FreePool (TmpBuf);
 
   return EFI_SUCCESS;
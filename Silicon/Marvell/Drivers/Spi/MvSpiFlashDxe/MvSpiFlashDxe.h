@@ -83,6 +83,13 @@ typedef enum {
   SPI_COMMAND_MAX
 } SPI_COMMAND;
 
+typedef enum {
+  SPI_FLASH_UPDATE_SKIPPED,    // Sector already held the new data
+  SPI_FLASH_UPDATE_PROGRAMMED, // Only bits cleared, no erase needed
+  SPI_FLASH_UPDATE_ERASED,     // Sector erased and rewritten
+  SPI_FLASH_UPDATE_ACTION_MAX
+} SPI_FLASH_UPDATE_ACTION;
+
 typedef struct {
   MARVELL_SPI_FLASH_PROTOCOL  SpiFlashProtocol;
   UINTN                   Signature;
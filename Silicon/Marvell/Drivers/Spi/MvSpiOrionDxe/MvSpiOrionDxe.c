@@ -186,6 +186,55 @@ SpiSetupTransfer (
   EfiReleaseLock (&SpiMaster->Lock);
 }
 
+STATIC
+VOID
+SpiSetWordMode (
+  IN UINTN SpiRegBase,
+  IN BOOLEAN Enable
+  )
+{
+  UINT32 Reg;
+
+  Reg = MmioRead32 (SpiRegBase + SPI_CONF_REG);
+  if (Enable) {
+    Reg |= SPI_BYTE_LENGTH;
+  } else {
+    Reg &= ~SPI_BYTE_LENGTH;
+  }
+  MmioWrite32 (SpiRegBase + SPI_CONF_REG, Reg);
+}
+
+//
+// Shift one byte or, in word mode, one 16-bit word (MSB first) through
+// the controller.
+//
+STATIC
+EFI_STATUS
+SpiTransferUnit (
+  IN  UINTN SpiRegBase,
+  IN  UINT32 DataOut,
+  OUT UINT32 *DataIn OPTIONAL
+  )
+{
+  UINT32 Iterator;
+
+  MmioWrite32 (SpiRegBase + SPI_INT_CAUSE_REG, 0x0);
+  MmioWrite32 (SpiRegBase + SPI_DATA_OUT_REG, DataOut);
+
+  // Wait for memory ready
+  for (Iterator = 0; Iterator < SPI_TIMEOUT; Iterator++) {
+    if (MmioRead32 (SpiRegBase + SPI_INT_CAUSE_REG)) {
+      if (DataIn != NULL) {
+        *DataIn = MmioRead32 (SpiRegBase + SPI_DATA_IN_REG);
+      }
+      return EFI_SUCCESS;
+    }
+  }
+
+  DEBUG ((DEBUG_ERROR, "%a: Timeout\n", __FUNCTION__));
+  return EFI_TIMEOUT;
+}
+
 EFI_STATUS
 EFIAPI
 MvSpiTransfer (
@@ -198,18 +247,23 @@ MvSpiTransfer (
   )
 {
   SPI_MASTER *SpiMaster;
-  UINT64  Length;
-  UINT32  Iterator, Reg;
+  EFI_STATUS Status;
+  UINTN   Words, Index;
+  UINT32  DataToSend, DataReceived;
   UINT8   *DataOutPtr = (UINT8 *)DataOut;
   UINT8   *DataInPtr  = (UINT8 *)DataIn;
-  UINT8   DataToSend  = 0;
   UINTN   SpiRegBase;
 
   SpiMaster = SPI_MASTER_FROM_SPI_MASTER_PROTOCOL (This);
 
   SpiRegBase = Slave->HostRegisterBaseAddress;
 
-  Length = 8 * DataByteCount;
+  Status = EFI_SUCCESS;
+  DataReceived = 0;
+  Words = 0;
+  if (DataByteCount >= SPI_WORD_MODE_MIN_LENGTH) {
+    Words = DataByteCount / 2;
+  }
 
   if (!EfiAtRuntime ()) {
     EfiAcquireLock (&SpiMaster->Lock);
@@ -219,40 +273,60 @@ MvSpiTransfer (
     SpiActivateCs (Slave);
   }
 
-  // Set 8-bit mode
-  Reg = MmioRead32 (SpiRegBase + SPI_CONF_REG);
-  Reg &= ~SPI_BYTE_LENGTH;
-  MmioWrite32 (SpiRegBase + SPI_CONF_REG, Reg);
-
-  while (Length > 0) {
-    if (DataOut != NULL) {
-      DataToSend = *DataOutPtr & 0xFF;
-    }
-    // Transmit Data
-    MmioWrite32 (SpiRegBase + SPI_INT_CAUSE_REG, 0x0);
-    MmioWrite32 (SpiRegBase + SPI_DATA_OUT_REG, DataToSend);
-    // Wait for memory ready
-    for (Iterator = 0; Iterator < SPI_TIMEOUT; Iterator++) {
-      if (MmioRead32 (SpiRegBase + SPI_INT_CAUSE_REG)) {
-        if (DataInPtr != NULL) {
-          *DataInPtr = MmioRead32 (SpiRegBase + SPI_DATA_IN_REG);
-          DataInPtr++;
+  //
+  // Move the bulk of long transfers in 16-bit mode. Bytes go out in
+  // buffer order, so the first byte is the word's high byte.
+  //
+  if (Words > 0) {
+    SpiSetWordMode (SpiRegBase, TRUE);
+
+    if (DataOutPtr == NULL) {
+      // Read only, clock out zeros
+      for (Index = 0; Index < Words; Index++) {
+        Status = SpiTransferUnit (SpiRegBase, 0, &DataReceived);
+        if (EFI_ERROR (Status)) {
+          break;
         }
-        if (DataOutPtr != NULL) {
-          DataOutPtr++;
+        *DataInPtr++ = (UINT8)(DataReceived >> 8);
+        *DataInPtr++ = (UINT8)DataReceived;
+      }
+    } else {
+      for (Index = 0; Index < Words; Index++) {
+        DataToSend = (DataOutPtr[0] << 8) | DataOutPtr[1];
+        DataOutPtr += 2;
+        Status = SpiTransferUnit (SpiRegBase, DataToSend,
+                   DataInPtr != NULL ? &DataReceived : NULL);
+        if (EFI_ERROR (Status)) {
+          break;
+        }
+        if (DataInPtr != NULL) {
+          *DataInPtr++ = (UINT8)(DataReceived >> 8);
+          *DataInPtr++ = (UINT8)DataReceived;
         }
-        Length -= 8;
-        break;
       }
     }
+  }
 
-    if (Iterator >= SPI_TIMEOUT) {
-      DEBUG ((DEBUG_ERROR, "%a: Timeout\n", __FUNCTION__));
-      return EFI_TIMEOUT;
+  // Set 8-bit mode for the remainder
+  SpiSetWordMode (SpiRegBase, FALSE);
+
+  for (Index = 2 * Words; Index < DataByteCount && !EFI_ERROR (Status); Index++) {
+    DataToSend = 0;
+    if (DataOutPtr != NULL) {
+      DataToSend = *DataOutPtr++;
+    }
+    Status = SpiTransferUnit (SpiRegBase, DataToSend,
+               DataInPtr != NULL ? &DataReceived : NULL);
+    if (!EFI_ERROR (Status) && DataInPtr != NULL) {
+      *DataInPtr++ = (UINT8)DataReceived;
     }
   }
 
-  if (Flag & SPI_TRANSFER_END) {
+  //
+  // A failed transfer ends here, whatever the caller planned, so the
+  // device is not left selected.
+  //
+  if (EFI_ERROR (Status) || (Flag & SPI_TRANSFER_END)) {
     SpiDeactivateCs (Slave);
   }
 
@@ -260,7 +334,7 @@ MvSpiTransfer (
     EfiReleaseLock (&SpiMaster->Lock);
   }
 
-  return EFI_SUCCESS;
+  return Status;
 }
 
 EFI_STATUS
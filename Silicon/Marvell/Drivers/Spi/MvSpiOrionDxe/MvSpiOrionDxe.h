@@ -87,6 +87,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define SPI_TIMEOUT                     100000
 
+// Transfers this long or longer move two bytes per data register access
+#define SPI_WORD_MODE_MIN_LENGTH        16
+
 typedef struct {
   MARVELL_SPI_MASTER_PROTOCOL SpiMasterProtocol;
   UINTN                   Signature;
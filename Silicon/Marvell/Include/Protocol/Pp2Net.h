@@ -0,0 +1,226 @@
+/********************************************************************************
+Copyright (C) 2017 Marvell International Ltd.
+
+Marvell BSD License Option
+
+If you received this File from Marvell, you may opt to use, redistribute and/or
+modify this File under the following licensing terms.
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+  * Redistributions of source code must retain the above copyright notice,
+    this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+
+  * Neither the name of Marvell nor the names of its contributors may be
+    used to endorse or promote products derived from this software without
+    specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*******************************************************************************/
+
+#ifndef __PP2_NET_H__
+#define __PP2_NET_H__
+
+#define MARVELL_PP2_NET_PROTOCOL_GUID { 0x8b3a5f7e, 0x1c4d, 0x4e29, { 0x9a, 0x61, 0x3f, 0x0b, 0xd2, 0x7c, 0x45, 0x9e }}
+
+typedef struct _MARVELL_PP2_NET_PROTOCOL MARVELL_PP2_NET_PROTOCOL;
+typedef struct _MARVELL_PP2_RX_BUFFER MARVELL_PP2_RX_BUFFER;
+
+/*
+ * MARVELL_PP2_RX_BUFFER_RELEASE returns the buffer obtained from
+ * MARVELL_PP2_NET_RECEIVE_ZERO_COPY to the buffer manager pool.
+ * RxBuffer must not be accessed after this call. If the interface has been
+ * stopped or shut down meanwhile, EFI_NOT_STARTED is returned and the buffer
+ * goes back to the pool once the interface is initialized again.
+ */
+typedef
+EFI_STATUS
+(EFIAPI *MARVELL_PP2_RX_BUFFER_RELEASE) (
+  IN MARVELL_PP2_RX_BUFFER *RxBuffer
+  );
+
+struct _MARVELL_PP2_RX_BUFFER {
+  /* Received frame, starting with the media header */
+  VOID                          *Packet;
+  UINTN                         PacketSize;
+  MARVELL_PP2_RX_BUFFER_RELEASE Release;
+};
+
+/*
+ * MARVELL_PP2_NET_RECEIVE_ZERO_COPY hands the caller the next received frame
+ * in place, i.e. without copying it out of the buffer manager pool. The buffer
+ * is owned by the caller until it is returned with RxBuffer->Release. Only a
+ * limited number of buffers can be held at a time, EFI_OUT_OF_RESOURCES is
+ * returned when this limit is reached.
+ */
+typedef
+EFI_STATUS
+(EFIAPI *MARVELL_PP2_NET_RECEIVE_ZERO_COPY) (
+  IN MARVELL_PP2_NET_PROTOCOL *This,
+  OUT MARVELL_PP2_RX_BUFFER **RxBuffer
+  );
+
+/*
+ * MARVELL_PP2_NET_RECEIVE_BURST works like MARVELL_PP2_NET_RECEIVE_ZERO_COPY,
+ * but drains up to *Count received frames into RxBuffers array at once.
+ * On return *Count holds the number of obtained frames, each of them has to
+ * be released separately.
+ */
+typedef
+EFI_STATUS
+(EFIAPI *MARVELL_PP2_NET_RECEIVE_BURST) (
+  IN MARVELL_PP2_NET_PROTOCOL *This,
+  OUT MARVELL_PP2_RX_BUFFER **RxBuffers,
+  IN OUT UINTN *Count
+  );
+
+/*
+ * MARVELL_PP2_NET_GET_QUEUE_COUNT returns the number of RX and TX queues
+ * used by the port. The classifier steers all traffic of the port to a single
+ * RX queue, the number of TX queues is configured with PcdPp2TxqNumber.
+ */
+typedef
+EFI_STATUS
+(EFIAPI *MARVELL_PP2_NET_GET_QUEUE_COUNT) (
+  IN MARVELL_PP2_NET_PROTOCOL *This,
+  OUT UINTN *RxQueueCount,
+  OUT UINTN *TxQueueCount
+  );
+
+/*
+ * MARVELL_PP2_NET_TRANSMIT_QUEUE places a complete frame on the given TX queue.
+ * The buffer must stay intact until it is returned by
+ * MARVELL_PP2_NET_RECYCLE_QUEUE of the same queue. EFI_NOT_READY is returned
+ * when the queue is full. Each queue is serialized separately and boot services
+ * are not used, so distinct queues can be served from distinct processors.
+ */
+typedef
+EFI_STATUS
+(EFIAPI *MARVELL_PP2_NET_TRANSMIT_QUEUE) (
+  IN MARVELL_PP2_NET_PROTOCOL *This,
+  IN UINTN TxQueue,
+  IN VOID *Buffer,
+  IN UINTN BufferSize
+  );
+
+/*
+ * MARVELL_PP2_NET_RECYCLE_QUEUE returns a buffer of a frame already sent
+ * from the given TX queue, or NULL in *Buffer if there is none.
+ */
+typedef
+EFI_STATUS
+(EFIAPI *MARVELL_PP2_NET_RECYCLE_QUEUE) (
+  IN MARVELL_PP2_NET_PROTOCOL *This,
+  IN UINTN TxQueue,
+  OUT VOID **Buffer
+  );
+
+typedef struct {
+  /* Number of frames collected before they are handed over */
+  UINT32 Packets;
+  /* Maximum time a frame is held back waiting for Packets frames */
+  UINT32 Usec;
+  /*
+   * Number of times frames were taken from the RX queue and the total number
+   * of frames taken, since coalescing was last set. PolledPackets / Polls is
+   * the achieved number of frames processed per poll.
+   */
+  UINT64 Polls;
+  UINT64 PolledPackets;
+} MARVELL_PP2_RX_COALESCING;
+
+/*
+ * MARVELL_PP2_NET_SET_RX_COALESCING sets coalescing of the given RX queue.
+ * Received frames are not reported until Packets of them are collected, or the
+ * oldest one has waited for Usec microseconds. Usec equal to 0 disables
+ * coalescing. Defaults are taken from PcdPp2RxCoalPkts and PcdPp2RxCoalUsec.
+ */
+typedef
+EFI_STATUS
+(EFIAPI *MARVELL_PP2_NET_SET_RX_COALESCING) (
+  IN MARVELL_PP2_NET_PROTOCOL *This,
+  IN UINTN RxQueue,
+  IN UINT32 Packets,
+  IN UINT32 Usec
+  );
+
+/*
+ * MARVELL_PP2_NET_GET_RX_COALESCING returns coalescing settings of the given
+ * RX queue together with the achieved statistics.
+ */
+typedef
+EFI_STATUS
+(EFIAPI *MARVELL_PP2_NET_GET_RX_COALESCING) (
+  IN MARVELL_PP2_NET_PROTOCOL *This,
+  IN UINTN RxQueue,
+  OUT MARVELL_PP2_RX_COALESCING *Coalescing
+  );
+
+/*
+ * MARVELL_PP2_NET_SET_CHECKSUM_OFFLOAD enables or disables checksum offload.
+ * When enabled, HW calculates the IPv4 header checksum and TCP/UDP checksum
+ * of all IPv4 and IPv6 frames sent, except for IP fragments. The checksum
+ * fields are overwritten by HW, so the caller may leave them zeroed.
+ * Received frames are not checked, their checksums are left to the caller.
+ */
+typedef
+EFI_STATUS
+(EFIAPI *MARVELL_PP2_NET_SET_CHECKSUM_OFFLOAD) (
+  IN MARVELL_PP2_NET_PROTOCOL *This,
+  IN BOOLEAN Enable
+  );
+
+typedef struct {
+  /* RX descriptors consumed and frames dropped because of errors */
+  UINT64 RxDescConsumed;
+  UINT64 RxDropped;
+  /* Zero-copy receive attempts that found no free buffer loan */
+  UINT64 RxLoanFailures;
+  /* TX descriptors queued to the HW and frames rejected because the queue was full */
+  UINT64 TxDescQueued;
+  UINT64 TxQueueFull;
+} MARVELL_PP2_QUEUE_STATISTICS;
+
+/*
+ * MARVELL_PP2_NET_GET_QUEUE_STATISTICS returns software counters of the given
+ * RX and TX queue pair, accumulated since the driver was loaded. Counters of
+ * a direction in which the queue does not exist are reported as zero.
+ * The RX queue is serialized with TPL, so it is only read from the boot
+ * processor.
+ */
+typedef
+EFI_STATUS
+(EFIAPI *MARVELL_PP2_NET_GET_QUEUE_STATISTICS) (
+  IN MARVELL_PP2_NET_PROTOCOL *This,
+  IN UINTN Queue,
+  OUT MARVELL_PP2_QUEUE_STATISTICS *Statistics
+  );
+
+struct _MARVELL_PP2_NET_PROTOCOL {
+  MARVELL_PP2_NET_RECEIVE_ZERO_COPY ReceiveZeroCopy;
+  MARVELL_PP2_NET_RECEIVE_BURST ReceiveBurst;
+  MARVELL_PP2_NET_GET_QUEUE_COUNT GetQueueCount;
+  MARVELL_PP2_NET_TRANSMIT_QUEUE TransmitQueue;
+  MARVELL_PP2_NET_RECYCLE_QUEUE RecycleQueue;
+  MARVELL_PP2_NET_SET_RX_COALESCING SetRxCoalescing;
+  MARVELL_PP2_NET_GET_RX_COALESCING GetRxCoalescing;
+  MARVELL_PP2_NET_SET_CHECKSUM_OFFLOAD SetChecksumOffload;
+  MARVELL_PP2_NET_GET_QUEUE_STATISTICS GetQueueStatistics;
+};
+
+extern EFI_GUID gMarvellPp2NetProtocolGuid;
+#endif
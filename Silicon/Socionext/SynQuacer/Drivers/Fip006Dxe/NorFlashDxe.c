@@ -18,6 +18,7 @@
 #include <Library/MemoryAllocationLib.h>
 #include <Library/NorFlashInfoLib.h>
 #include <Library/PcdLib.h>
+#include <Library/TimerLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiLib.h>
 
@@ -121,6 +122,7 @@ GenCSDC (
   IN  BOOLEAN   AddrMode4Byte,
   IN  BOOLEAN   HighZ,
   IN  UINT8     TransferMode,
+  IN  UINT8     Continuous,
   OUT UINT16    *CmdSeq
   )
 {
@@ -133,33 +135,39 @@ GenCSDC (
   Index = 0;
   CopyMem (CmdSeq, mFip006NullCmdSeq, sizeof (mFip006NullCmdSeq));
 
-  CmdSeq[Index++] = CSDC (Cmd, CSDC_CONT_NON_CONTINUOUS, TransferMode,
+  CmdSeq[Index++] = CSDC (Cmd, Continuous, TransferMode,
                           CSDC_DEC_LEAVE_ASIS);
   if (AddrAccess) {
     if (AddrMode4Byte) {
-      CmdSeq[Index++] = CSDC (CSDC_ADDRESS_31_24, CSDC_CONT_NON_CONTINUOUS,
+      CmdSeq[Index++] = CSDC (CSDC_ADDRESS_31_24, Continuous,
                               TransferMode, CSDC_DEC_DECODE);
     }
-    CmdSeq[Index++] = CSDC (CSDC_ADDRESS_23_16, CSDC_CONT_NON_CONTINUOUS,
+    CmdSeq[Index++] = CSDC (CSDC_ADDRESS_23_16, Continuous,
                             TransferMode, CSDC_DEC_DECODE);
-    CmdSeq[Index++] = CSDC (CSDC_ADDRESS_15_8, CSDC_CONT_NON_CONTINUOUS,
+    CmdSeq[Index++] = CSDC (CSDC_ADDRESS_15_8, Continuous,
                             TransferMode, CSDC_DEC_DECODE);
-    CmdSeq[Index++] = CSDC (CSDC_ADDRESS_7_0, CSDC_CONT_NON_CONTINUOUS,
+    CmdSeq[Index++] = CSDC (CSDC_ADDRESS_7_0, Continuous,
                             TransferMode, CSDC_DEC_DECODE);
   }
   if (HighZ) {
-    CmdSeq[Index++] = CSDC (CSDC_HIGH_Z, CSDC_CONT_NON_CONTINUOUS,
+    CmdSeq[Index++] = CSDC (CSDC_HIGH_Z, Continuous,
                             TransferMode, CSDC_DEC_DECODE);
   }
 
   return EFI_SUCCESS;
 }
 
+//
+// In continuous mode, the command sequencer merges accesses to consecutive
+// addresses into a single SPI transaction instead of issuing the command and
+// address again for each of them.
+//
 STATIC
 EFI_STATUS
-NorFlashSetHostCommand (
+NorFlashSetHostCommandEx (
   IN  NOR_FLASH_INSTANCE    *Instance,
-  IN  UINT8                 Code
+  IN  UINT8                 Code,
+  IN  BOOLEAN               Continuous
   )
 {
   CONST CSDC_DEFINITION     *Cmd;
@@ -175,12 +183,90 @@ NorFlashSetHostCommand (
       Cmd->AddrMode4Byte,
       Cmd->HighZ,
       Cmd->CsdcTrp,
+      Continuous ? CSDC_CONT_CONTINUOUS : CSDC_CONT_NON_CONTINUOUS,
       CSDC
       );
   NorFlashSetHostCSDC (Instance, Cmd->ReadWrite, CSDC);
   return EFI_SUCCESS;
 }
 
+STATIC
+EFI_STATUS
+NorFlashSetHostCommand (
+  IN  NOR_FLASH_INSTANCE    *Instance,
+  IN  UINT8                 Code
+  )
+{
+  return NorFlashSetHostCommandEx (Instance, Code, FALSE);
+}
+
+//
+// A step is a single command issue or status poll. It must not be interrupted
+// since the command sequencer setup is shared by every flash access, but it is
+// short, so blocking interrupts for its duration is acceptable. Erase and
+// program cycles are waited for between steps, with interrupts enabled.
+//
+STATIC
+UINTN
+NorFlashBeginStep (
+  VOID
+  )
+{
+  if (!EfiAtRuntime ()) {
+    return gBS->RaiseTPL (TPL_HIGH_LEVEL);
+  }
+  return SaveAndDisableInterrupts ();
+}
+
+STATIC
+VOID
+NorFlashEndStep (
+  IN  UINTN                 State
+  )
+{
+  if (!EfiAtRuntime ()) {
+    gBS->RestoreTPL ((EFI_TPL)State);
+  } else if (State) {
+    SetInterruptState (TRUE);
+  }
+}
+
+//
+// A whole erase or program operation only needs to be serialised against
+// other flash users. At boot time, TPL_NOTIFY keeps them out while leaving
+// the timer interrupt running. A caller already running above TPL_NOTIFY
+// stays at its own level, since RaiseTPL () cannot lower it. At runtime,
+// the OS already serialises calls into runtime services.
+//
+STATIC
+EFI_TPL
+NorFlashBeginOperation (
+  VOID
+  )
+{
+  EFI_TPL     OriginalTPL;
+
+  if (!EfiAtRuntime ()) {
+    // Raising to TPL_HIGH_LEVEL is always allowed and returns the current TPL
+    OriginalTPL = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+    gBS->RestoreTPL (OriginalTPL);
+    gBS->RaiseTPL (MAX (OriginalTPL, TPL_NOTIFY));
+    return OriginalTPL;
+  }
+  return TPL_APPLICATION;
+}
+
+STATIC
+VOID
+NorFlashEndOperation (
+  IN  EFI_TPL               OriginalTPL
+  )
+{
+  if (!EfiAtRuntime ()) {
+    gBS->RestoreTPL (OriginalTPL);
+  }
+}
+
 STATIC
 UINT8
 NorFlashReadStatusRegister (
@@ -203,10 +289,14 @@ NorFlashWaitProgramErase (
 {
   BOOLEAN     SRegDone;
   BOOLEAN     FSRegDone;
+  UINTN       Step;
+  UINTN       Polls;
 
   DEBUG ((DEBUG_BLKIO, "NorFlashWaitProgramErase()\n"));
 
-  do {
+  // Each poll is a step of its own, interrupts are taken in between
+  for (Polls = 0; ; Polls++) {
+    Step = NorFlashBeginStep ();
     SRegDone = (NorFlashReadStatusRegister (Instance) & SPINOR_SR_WIP) == 0;
     FSRegDone = TRUE;
     if (Instance->Flags & NOR_FLASH_POLL_FSR) {
@@ -214,9 +304,18 @@ NorFlashWaitProgramErase (
       FSRegDone = (MmioRead8 (Instance->RegionBaseAddress) &
                    SPINOR_FSR_READY) != 0;
     }
-  } while (!SRegDone || !FSRegDone);
-  NorFlashSetHostCommand (Instance, SPINOR_OP_READ_4B);
-  return EFI_SUCCESS;
+    NorFlashSetHostCommand (Instance, SPINOR_OP_READ_4B);
+    NorFlashEndStep (Step);
+
+    if (SRegDone && FSRegDone) {
+      return EFI_SUCCESS;
+    }
+    if (Polls >= SPINOR_BUSY_TIMEOUT_US / SPINOR_POLL_DELAY_US) {
+      DEBUG ((DEBUG_ERROR, "%a: timeout\n", __FUNCTION__));
+      return EFI_TIMEOUT;
+    }
+    MicroSecondDelay (SPINOR_POLL_DELAY_US);
+  }
 }
 
 // TODO: implement lock checking
@@ -321,14 +420,13 @@ NorFlashEraseSingleBlock (
   IN UINTN                  BlockAddress
   )
 {
+  EFI_STATUS      Status;
+  EFI_STATUS      WaitStatus;
+  UINTN           Step;
 
   DEBUG ((DEBUG_BLKIO, "NorFlashEraseSingleBlock(BlockAddress=0x%08x)\n",
     BlockAddress));
 
-  if (EFI_ERROR (NorFlashEnableWrite (Instance))) {
-    return EFI_DEVICE_ERROR;
-  }
-
   //
   // The virtual address chosen by the OS may have a different offset modulo
   // 16 MB than the physical address, so we need to subtract the region base
@@ -341,13 +439,24 @@ NorFlashEraseSingleBlock (
     BlockAddress += Instance->OffsetLba * Instance->Media.BlockSize;
   }
 
+  Step = NorFlashBeginStep ();
+  if (EFI_ERROR (NorFlashEnableWrite (Instance))) {
+    NorFlashEndStep (Step);
+    return EFI_DEVICE_ERROR;
+  }
   NorFlashSetHostCSDC (Instance, TRUE, mFip006NullCmdSeq);
   MmioWrite32 (Instance->DeviceBaseAddress,
                SwapBytes32 (BlockAddress & 0x00FFFFFF) | SPINOR_OP_SE);
-  NorFlashWaitProgramErase (Instance);
+  NorFlashEndStep (Step);
+
+  WaitStatus = NorFlashWaitProgramErase (Instance);
+
+  Step = NorFlashBeginStep ();
   NorFlashSetHostCSDC (Instance, TRUE, mFip006NullCmdSeq);
+  Status = NorFlashDisableWrite (Instance);
+  NorFlashEndStep (Step);
 
-  if (EFI_ERROR (NorFlashDisableWrite (Instance))) {
+  if (EFI_ERROR (WaitStatus) || EFI_ERROR (Status)) {
     return EFI_DEVICE_ERROR;
   }
   return EFI_SUCCESS;
@@ -365,17 +474,8 @@ NorFlashUnlockAndEraseSingleBlock (
   EFI_STATUS      Status;
   UINTN           Index;
   EFI_TPL         OriginalTPL;
-  BOOLEAN         InterruptsEnabled;
-
-  OriginalTPL = 0;
-  InterruptsEnabled = FALSE;
 
-  if (!EfiAtRuntime ()) {
-    // Raise TPL to TPL_HIGH to stop anyone from interrupting us.
-    OriginalTPL = gBS->RaiseTPL (TPL_HIGH_LEVEL);
-  } else {
-    InterruptsEnabled = SaveAndDisableInterrupts ();
-  }
+  OriginalTPL = NorFlashBeginOperation ();
 
   Index = 0;
   // The block erase might fail a first time (SW bug ?). Retry it ...
@@ -395,12 +495,7 @@ NorFlashUnlockAndEraseSingleBlock (
       BlockAddress,Index));
   }
 
-  if (!EfiAtRuntime ()) {
-    // Interruptions can resume.
-    gBS->RestoreTPL (OriginalTPL);
-  } else if (InterruptsEnabled) {
-    SetInterruptState (TRUE);
-  }
+  NorFlashEndOperation (OriginalTPL);
 
   return Status;
 }
@@ -414,6 +509,7 @@ NorFlashWriteSingleWord (
   )
 {
   EFI_STATUS            Status;
+  UINTN                 Step;
 
   DEBUG ((DEBUG_BLKIO,
     "NorFlashWriteSingleWord(WordAddress=0x%08x, WriteData=0x%08x)\n",
@@ -421,18 +517,92 @@ NorFlashWriteSingleWord (
 
   Status = EFI_SUCCESS;
 
+  Step = NorFlashBeginStep ();
   if (EFI_ERROR (NorFlashEnableWrite (Instance))) {
+    NorFlashEndStep (Step);
     return EFI_DEVICE_ERROR;
   }
   NorFlashSetHostCommand (Instance, SPINOR_OP_PP);
   MmioWrite32 (WordAddress, WriteData);
-  NorFlashWaitProgramErase (Instance);
+  NorFlashEndStep (Step);
+
+  Status = NorFlashWaitProgramErase (Instance);
 
+  Step = NorFlashBeginStep ();
   NorFlashDisableWrite (Instance);
   NorFlashSetHostCSDC (Instance, TRUE, mFip006NullCmdSeq);
+  NorFlashEndStep (Step);
   return Status;
 }
 
+/**
+ * Program up to one page with a single page program command, enabling writes
+ * and polling for completion once per page rather than once per word. The
+ * range must be word aligned and must not cross a page boundary.
+ **/
+EFI_STATUS
+NorFlashWriteBuffer (
+  IN NOR_FLASH_INSTANCE     *Instance,
+  IN UINTN                  TargetAddress,
+  IN UINTN                  BufferSizeInBytes,
+  IN UINT32                 *Buffer
+  )
+{
+  EFI_STATUS            Status;
+  UINTN                 Index;
+  UINTN                 Count;
+  UINTN                 Step;
+
+  DEBUG ((DEBUG_BLKIO,
+    "NorFlashWriteBuffer(TargetAddress=0x%08x, BufferSizeInBytes=0x%x)\n",
+    TargetAddress, BufferSizeInBytes));
+
+  if (((TargetAddress | BufferSizeInBytes) & 0x3) != 0 ||
+      (TargetAddress & (SPINOR_PAGE_SIZE - 1)) + BufferSizeInBytes >
+      SPINOR_PAGE_SIZE) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Count = BufferSizeInBytes / sizeof (UINT32);
+
+  // The burst must not be interrupted or the sequencer would close it early
+  Step = NorFlashBeginStep ();
+  if (EFI_ERROR (NorFlashEnableWrite (Instance))) {
+    NorFlashEndStep (Step);
+    return EFI_DEVICE_ERROR;
+  }
+  NorFlashSetHostCommandEx (Instance, SPINOR_OP_PP, TRUE);
+  for (Index = 0; Index < Count; Index++) {
+    MmioWrite32 (TargetAddress + Index * sizeof (UINT32), Buffer[Index]);
+  }
+  MemoryFence ();
+  NorFlashEndStep (Step);
+
+  Status = NorFlashWaitProgramErase (Instance);
+
+  Step = NorFlashBeginStep ();
+  NorFlashDisableWrite (Instance);
+  NorFlashSetHostCSDC (Instance, TRUE, mFip006NullCmdSeq);
+  NorFlashEndStep (Step);
+
+  if (EFI_ERROR (Status)) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  //
+  // A page program that is cut short does not report an error, so check
+  // that the whole page made it to the flash before reporting success.
+  //
+  for (Index = 0; Index < Count; Index++) {
+    if (MmioRead32 (TargetAddress + Index * sizeof (UINT32)) != Buffer[Index]) {
+      DEBUG ((DEBUG_ERROR, "%a: verify failed at 0x%lx\n", __FUNCTION__,
+        (UINT64)(TargetAddress + Index * sizeof (UINT32))));
+      return EFI_DEVICE_ERROR;
+    }
+  }
+  return EFI_SUCCESS;
+}
+
 STATIC
 EFI_STATUS
 NorFlashWriteFullBlock (
@@ -445,13 +615,11 @@ NorFlashWriteFullBlock (
   EFI_STATUS    Status;
   UINTN         WordAddress;
   UINT32        WordIndex;
+  UINT32        PageSizeInWords;
   UINTN         BlockAddress;
   EFI_TPL       OriginalTPL;
-  BOOLEAN       InterruptsEnabled;
 
   Status = EFI_SUCCESS;
-  OriginalTPL = 0;
-  InterruptsEnabled = FALSE;
 
   // Get the physical address of the block
   BlockAddress = GET_NOR_BLOCK_ADDRESS (Instance->RegionBaseAddress, Lba,
@@ -460,12 +628,9 @@ NorFlashWriteFullBlock (
   // Start writing from the first address at the start of the block
   WordAddress = BlockAddress;
 
-  if (!EfiAtRuntime ()) {
-    // Raise TPL to TPL_HIGH to stop anyone from interrupting us.
-    OriginalTPL = gBS->RaiseTPL (TPL_HIGH_LEVEL);
-  } else {
-    InterruptsEnabled = SaveAndDisableInterrupts ();
-  }
+  // Only the individual commands run with interrupts blocked, the erase and
+  // page program cycles are waited for with interrupts enabled.
+  OriginalTPL = NorFlashBeginOperation ();
 
   Status = NorFlashUnlockAndEraseSingleBlock (Instance, BlockAddress);
   if (EFI_ERROR (Status)) {
@@ -475,22 +640,21 @@ NorFlashWriteFullBlock (
     goto EXIT;
   }
 
+  // Erase blocks are page aligned, so each iteration programs a whole page
   for (WordIndex=0;
        WordIndex < BlockSizeInWords;
-       WordIndex++, DataBuffer++, WordAddress += 4) {
-    Status = NorFlashWriteSingleWord (Instance, WordAddress, *DataBuffer);
+       WordIndex += PageSizeInWords, DataBuffer += PageSizeInWords,
+       WordAddress += PageSizeInWords * 4) {
+    PageSizeInWords = MIN (SPINOR_PAGE_SIZE / 4, BlockSizeInWords - WordIndex);
+    Status = NorFlashWriteBuffer (Instance, WordAddress, PageSizeInWords * 4,
+               DataBuffer);
     if (EFI_ERROR (Status)) {
       goto EXIT;
     }
   }
 
 EXIT:
-  if (!EfiAtRuntime ()) {
-    // Interruptions can resume.
-    gBS->RestoreTPL (OriginalTPL);
-  } else if (InterruptsEnabled) {
-    SetInterruptState (TRUE);
-  }
+  NorFlashEndOperation (OriginalTPL);
 
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR,
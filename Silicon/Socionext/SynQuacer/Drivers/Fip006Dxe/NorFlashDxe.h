@@ -310,6 +310,11 @@ NorFlashReadID (
   OUT UINT8               JedecId[3]
   );
 
+#define SPINOR_PAGE_SIZE              256   // Page program granularity
+
+#define SPINOR_POLL_DELAY_US          10    // Delay between busy polls
+#define SPINOR_BUSY_TIMEOUT_US        5000000 // Longer than a sector erase
+
 #define SPINOR_SR_WIP                 BIT0  // Write in progress
 #define SPINOR_FSR_READY              BIT7  // Flag Status Register: ready
 
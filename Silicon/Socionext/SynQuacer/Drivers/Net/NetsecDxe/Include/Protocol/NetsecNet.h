@@ -0,0 +1,123 @@
+/** @file
+
+  Driver private protocol of the NETSEC Ethernet driver, which offers
+  zero-copy burst reception on top of the Simple Network Protocol.
+
+  Copyright (c) 2017, Linaro, Ltd. All rights reserved.<BR>
+
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef __NETSEC_NET_H__
+#define __NETSEC_NET_H__
+
+#define NETSEC_NET_PROTOCOL_GUID \
+  { 0x33bd96ae, 0x0d87, 0x4279, { 0xb4, 0xfd, 0x4e, 0xc1, 0x9f, 0x7e, 0x6a, 0x1a } }
+
+typedef struct _NETSEC_NET_PROTOCOL NETSEC_NET_PROTOCOL;
+typedef struct _NETSEC_RX_BUFFER    NETSEC_RX_BUFFER;
+
+//
+// Return a buffer obtained from NETSEC_NET_RECEIVE_BURST to the driver, so
+// it can be used for reception again. Must be called at TPL_CALLBACK or
+// lower. RxBuffer must not be accessed after this call. If the interface
+// has been shut down or stopped meanwhile, EFI_NOT_STARTED is returned and
+// the buffer is reclaimed when the interface is initialized again. The
+// driver refuses to be disconnected while any buffer is still held.
+//
+typedef
+EFI_STATUS
+(EFIAPI *NETSEC_RX_BUFFER_RELEASE) (
+  IN  NETSEC_RX_BUFFER              *RxBuffer
+  );
+
+struct _NETSEC_RX_BUFFER {
+  // Received frame, starting with the media header
+  VOID                              *Packet;
+  UINTN                             PacketSize;
+  NETSEC_RX_BUFFER_RELEASE          Release;
+};
+
+//
+// Hand the caller up to *Count received frames in place, i.e. without
+// copying them out of the RX ring buffers. On return, *Count holds the
+// number of frames stored in RxBuffers, each of which is owned by the
+// caller until it is returned with its Release () function. Only a limited
+// number of buffers can be held at a time; EFI_OUT_OF_RESOURCES is returned
+// when that limit has been reached, and EFI_NOT_READY when no frames are
+// pending.
+//
+typedef
+EFI_STATUS
+(EFIAPI *NETSEC_NET_RECEIVE_BURST) (
+  IN      NETSEC_NET_PROTOCOL       *This,
+      OUT NETSEC_RX_BUFFER          **RxBuffers,
+  IN  OUT UINTN                     *Count
+  );
+
+//
+// Set the RX interrupt coalescing parameters: the RX interrupt is raised
+// after Packets frames (1 - 2047) or Usec microseconds (0 disables the
+// timer), whichever comes first. The defaults are PcdRxIntPktCnt and
+// PcdRxIntTmrCntUs. New values take effect immediately if the interface is
+// initialized, or when it is initialized next otherwise.
+//
+typedef
+EFI_STATUS
+(EFIAPI *NETSEC_NET_SET_RX_COALESCING) (
+  IN  NETSEC_NET_PROTOCOL           *This,
+  IN  UINTN                         Packets,
+  IN  UINTN                         Usec
+  );
+
+typedef
+EFI_STATUS
+(EFIAPI *NETSEC_NET_GET_RX_COALESCING) (
+  IN  NETSEC_NET_PROTOCOL           *This,
+  OUT UINTN                         *Packets,
+  OUT UINTN                         *Usec
+  );
+
+typedef struct {
+  // Descriptor ring sizes (PcdDecRxDescNum and PcdEncTxDescNum)
+  UINTN                             RxRingEntries;
+  UINTN                             TxRingEntries;
+  // Frames received, and RX batches reported by the RX packet counter
+  UINT64                            RxPackets;
+  UINT64                            RxBatches;
+  // Frames dropped because no replacement RX buffer was available
+  UINT64                            RxDropped;
+  // Frames queued for transmission, and transmit attempts rejected because
+  // the TX ring was full
+  UINT64                            TxPackets;
+  UINT64                            TxRingFull;
+} NETSEC_NET_COUNTERS;
+
+//
+// Return the ring sizes and the data path counters accumulated since the
+// driver was started.
+//
+typedef
+EFI_STATUS
+(EFIAPI *NETSEC_NET_GET_COUNTERS) (
+  IN  NETSEC_NET_PROTOCOL           *This,
+  OUT NETSEC_NET_COUNTERS           *Counters
+  );
+
+struct _NETSEC_NET_PROTOCOL {
+  NETSEC_NET_RECEIVE_BURST          ReceiveBurst;
+  NETSEC_NET_SET_RX_COALESCING      SetRxCoalescing;
+  NETSEC_NET_GET_RX_COALESCING      GetRxCoalescing;
+  NETSEC_NET_GET_COUNTERS           GetCounters;
+};
+
+extern EFI_GUID gNetsecNetProtocolGuid;
+
+#endif
@@ -43,6 +43,7 @@ Probe (
 {
   ogma_param_t  Param;
   ogma_err_t    ogma_err;
+  pfdep_err_t   pfdep_err;
   UINT64        dmac_hm_cmd_base, dmac_mh_cmd_base, core_cmd_base;
   UINT32        dmac_hm_cmd_size, dmac_mh_cmd_size, core_cmd_size;
   UINT64        EepromBase;
@@ -100,9 +101,27 @@ Probe (
   core_cmd_base = MmioRead32 (EepromBase + PACKET_ME_ADDRESS);
   core_cmd_size = MmioRead32 (EepromBase + PACKET_ME_SIZE);
 
+  //
+  // Size the packet pool after the descriptor rings: one buffer per RX
+  // descriptor plus one spare, since ogma_get_rx_pkt_data () links a fresh
+  // buffer into the ring before handing the received one back, plus the
+  // buffers that may be lent to zero-copy receivers, and one handle per TX
+  // descriptor. The pool is passed to the ogma layer as its
+  // device handle so that the pfdep packet buffer hooks can find it.
+  //
+  pfdep_err = pfdep_pkt_pool_init (&LanDriver->PacketPool,
+                FixedPcdGet16 (PcdDecRxDescNum) + 1 + NETSEC_MAX_RX_LOANS,
+                Param.use_jumbo_pkt_flag ? OGMA_RX_JUMBO_PKT_BUF_LEN :
+                                           OGMA_RX_PKT_BUF_LEN,
+                FixedPcdGet16 (PcdEncTxDescNum));
+  if (pfdep_err != PFDEP_ERR_OK) {
+    DEBUG ((DEBUG_ERROR, "NETSEC: failed to allocate packet pool\n"));
+    return EFI_OUT_OF_RESOURCES;
+  }
+
   ogma_err = ogma_init (
                (VOID *)(UINTN)LanDriver->Dev->Resources[0].AddrRangeMin,
-               Handle, &Param,
+               &LanDriver->PacketPool, &Param,
                (VOID *)dmac_hm_cmd_base, dmac_hm_cmd_size,
                (VOID *)dmac_mh_cmd_base, dmac_mh_cmd_size,
                (VOID *)core_cmd_base, core_cmd_size,
@@ -110,6 +129,7 @@ Probe (
   if (ogma_err != OGMA_ERR_OK) {
     DEBUG ((DEBUG_ERROR, "NETSEC: ogma_init() failed with error code %d\n",
       ogma_err));
+    pfdep_pkt_pool_release (&LanDriver->PacketPool);
     return EFI_DEVICE_ERROR;
   }
 
@@ -171,6 +191,71 @@ ExitUnlock:
   return Status;
 }
 
+/*
+ *  Fold the GMAC MMC counters into the driver's 64-bit totals. The SDK
+ *  returns the whole MMC register block, which also holds the MMC interrupt
+ *  status and mask registers; only the counter registers are accumulated.
+ *
+ *  MMC_CNTL is never written, so the hardware counters run free and wrap at
+ *  32 bits. Each call adds the difference from the previous raw reading,
+ *  which is correct across a wrap as long as no counter advances by 2^32 or
+ *  more between two calls. With Fold FALSE, only the raw reading is recorded,
+ *  to establish a baseline after the GMAC has been (re)started.
+ */
+STATIC
+VOID
+NetsecMmcCountersUpdate (
+  IN  NETSEC_DRIVER       *LanDriver,
+  IN  BOOLEAN             Fold
+  )
+{
+  UINT32      Values[MMC_COUNTER_NUM];
+  UINTN       Index;
+  ogma_err_t  ogma_err;
+
+  ogma_err = ogma_read_gmac_stat (LanDriver->Handle, Values, OGMA_FALSE);
+  if (ogma_err != OGMA_ERR_OK) {
+    DEBUG ((DEBUG_WARN,
+      "NETSEC: ogma_read_gmac_stat failed with error code: %d\n",
+      (INT32)ogma_err));
+    return;
+  }
+
+  for (Index = 0; Index < MMC_COUNTER_NUM; Index++) {
+    if (!MMC_IS_COUNTER (Index)) {
+      continue;
+    }
+    if (Fold) {
+      LanDriver->MmcCounters[Index] +=
+        (UINT32)(Values[Index] - LanDriver->MmcLastRead[Index]);
+    }
+    LanDriver->MmcLastRead[Index] = Values[Index];
+  }
+}
+
+//
+// Free buffers whose Release () was called while the interface was down
+//
+STATIC
+VOID
+NetsecRxLoansReclaim (
+  IN  NETSEC_DRIVER       *LanDriver
+  )
+{
+  NETSEC_RX_LOAN  *RxLoan;
+  UINTN           Index;
+
+  for (Index = 0; Index < NETSEC_MAX_RX_LOANS; Index++) {
+    RxLoan = &LanDriver->RxLoans[Index];
+    if (RxLoan->InUse && RxLoan->Parked) {
+      pfdep_free_pkt_buf (&LanDriver->PacketPool, 0, NULL, 0, PFDEP_TRUE,
+        RxLoan->PktHandle);
+      RxLoan->Parked = FALSE;
+      RxLoan->InUse = FALSE;
+    }
+  }
+}
+
 /*
  *  UEFI Initialize() function
  */
@@ -218,6 +303,8 @@ SnpInitialize (
   // Find the LanDriver structure
   LanDriver = INSTANCE_FROM_SNP_THIS (Snp);
 
+  NetsecRxLoansReclaim (LanDriver);
+
   // Clean all descriptors on the RX ring.
   ogma_err = ogma_clean_rx_desc_ring (LanDriver->Handle,
                                       OGMA_DESC_RING_ID_NRM_RX);
@@ -227,6 +314,7 @@ SnpInitialize (
       (INT32)ogma_err));
     ReturnUnlock (EFI_DEVICE_ERROR);
   }
+  LanDriver->RxPending = 0;
 
   ogma_err = ogma_clean_tx_desc_ring (LanDriver->Handle,
                                       OGMA_DESC_RING_ID_NRM_TX);
@@ -252,8 +340,8 @@ SnpInitialize (
 
   ogma_err = ogma_set_irq_coalesce_param (LanDriver->Handle,
                                           OGMA_DESC_RING_ID_NRM_RX,
-                                          RXINT_PKTCNT, OGMA_FALSE,
-                                          RXINT_TMR_CNT_US);
+                                          LanDriver->RxIntPktCnt, OGMA_FALSE,
+                                          LanDriver->RxIntTmrCntUs);
   if (ogma_err != OGMA_ERR_OK) {
     DEBUG ((DEBUG_ERROR,
       "NETSEC: ogma_set_irq_coalesce_param() failed with error code %d\n",
@@ -317,6 +405,9 @@ SnpInitialize (
     ReturnUnlock (EFI_DEVICE_ERROR);
   }
 
+  // Counts from before the restart were folded in by Shutdown ()
+  NetsecMmcCountersUpdate (LanDriver, FALSE);
+
   // Declare the driver as initialized
   Snp->Mode->State = EfiSimpleNetworkInitialized;
   Status = EFI_SUCCESS;
@@ -370,6 +461,8 @@ SnpShutdown (
   // Find the LanDriver structure
   LanDriver = INSTANCE_FROM_SNP_THIS (Snp);
 
+  NetsecMmcCountersUpdate (LanDriver, TRUE);
+
   ogma_stop_gmac (LanDriver->Handle, OGMA_TRUE, OGMA_TRUE);
 
   ogma_stop_desc_ring (LanDriver->Handle, OGMA_DESC_RING_ID_NRM_RX);
@@ -511,6 +604,148 @@ ExitUnlock:
   return Status;
 }
 
+/*
+ *  UEFI Statistics() function
+ */
+STATIC
+EFI_STATUS
+EFIAPI
+SnpStatistics (
+  IN        EFI_SIMPLE_NETWORK_PROTOCOL   *Snp,
+  IN        BOOLEAN                       Reset,
+  IN  OUT   UINTN                         *StatSize     OPTIONAL,
+      OUT   EFI_NETWORK_STATISTICS        *Statistics   OPTIONAL
+  )
+{
+  NETSEC_DRIVER           *LanDriver;
+  EFI_TPL                 SavedTpl;
+  EFI_STATUS              Status;
+  EFI_NETWORK_STATISTICS  Stats;
+  UINT64                  *Mmc;
+
+  // Check preliminaries
+  if (Snp == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if ((StatSize == NULL) != (Statistics == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (!Reset && StatSize == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  // Serialize access to data and registers
+  SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  // Check that driver was started and initialised
+  switch (Snp->Mode->State) {
+  case EfiSimpleNetworkInitialized:
+    break;
+  case EfiSimpleNetworkStarted:
+    DEBUG ((DEBUG_WARN, "NETSEC: Driver not yet initialized\n"));
+    ReturnUnlock (EFI_DEVICE_ERROR);
+  case EfiSimpleNetworkStopped:
+    DEBUG ((DEBUG_WARN, "NETSEC: Driver not started\n"));
+    ReturnUnlock (EFI_NOT_STARTED);
+  default:
+    DEBUG ((DEBUG_ERROR, "NETSEC: Driver in an invalid state: %u\n",
+      (UINTN)Snp->Mode->State));
+    ReturnUnlock (EFI_DEVICE_ERROR);
+  }
+
+  // Find the LanDriver structure
+  LanDriver = INSTANCE_FROM_SNP_THIS (Snp);
+
+  NetsecMmcCountersUpdate (LanDriver, TRUE);
+  Mmc = LanDriver->MmcCounters;
+
+  Status = EFI_SUCCESS;
+
+  if (StatSize != NULL) {
+    // Statistics the hardware does not keep are reported as all ones
+    SetMem (&Stats, sizeof (Stats), 0xFF);
+
+    Stats.RxTotalFrames = Mmc[MMC_RXFRAMECOUNT_GB];
+    Stats.RxUnicastFrames = Mmc[MMC_RXUNICASTFRAMES_G];
+    Stats.RxBroadcastFrames = Mmc[MMC_RXBROADCASTFRAMES_G];
+    Stats.RxMulticastFrames = Mmc[MMC_RXMULTICASTFRAMES_G];
+    Stats.RxGoodFrames = Stats.RxUnicastFrames + Stats.RxBroadcastFrames +
+                         Stats.RxMulticastFrames;
+    Stats.RxUndersizeFrames = Mmc[MMC_RXUNDERSIZE_G] + Mmc[MMC_RXRUNTERROR];
+    Stats.RxOversizeFrames = Mmc[MMC_RXOVERSIZE_G] + Mmc[MMC_RXJABBERERROR];
+    Stats.RxDroppedFrames = Mmc[MMC_RXFIFOOVERFLOW] +
+                            LanDriver->Counters.RxDropped -
+                            LanDriver->RxDroppedAtReset;
+    Stats.RxCrcErrorFrames = Mmc[MMC_RXCRCERROR];
+    Stats.RxTotalBytes = Mmc[MMC_RXOCTETCOUNT_GB];
+
+    Stats.TxTotalFrames = Mmc[MMC_TXFRAMECOUNT_GB];
+    Stats.TxGoodFrames = Mmc[MMC_TXFRAMECOUNT_G];
+    Stats.TxUnicastFrames = Mmc[MMC_TXUNICASTFRAMES_GB];
+    Stats.TxBroadcastFrames = Mmc[MMC_TXBROADCASTFRAMES_G];
+    Stats.TxMulticastFrames = Mmc[MMC_TXMULTICASTFRAMES_G];
+    Stats.TxTotalBytes = Mmc[MMC_TXOCTETCOUNT_GB];
+    Stats.TxErrorFrames = Stats.TxTotalFrames - Stats.TxGoodFrames;
+    Stats.Collisions = Mmc[MMC_TXSINGLECOL_G] + Mmc[MMC_TXMULTICOL_G] +
+                       Mmc[MMC_TXLATECOL] + Mmc[MMC_TXEXESSCOL];
+
+    CopyMem (Statistics, &Stats, MIN (*StatSize, sizeof (Stats)));
+    if (*StatSize < sizeof (Stats)) {
+      Status = EFI_BUFFER_TOO_SMALL;
+    }
+    *StatSize = sizeof (Stats);
+  }
+
+  // Reset only clears the software totals; the hardware counters keep
+  // running and later readings are taken relative to MmcLastRead
+  if (Reset) {
+    ZeroMem (LanDriver->MmcCounters, sizeof (LanDriver->MmcCounters));
+    LanDriver->RxDroppedAtReset = LanDriver->Counters.RxDropped;
+  }
+
+  // Restore TPL and return
+ExitUnlock:
+  gBS->RestoreTPL (SavedTpl);
+  return Status;
+}
+
+/*
+ *  Reap completed descriptors from the TX ring. The buffers of completed
+ *  packets are marked as released on TxBufferList, and handed back to the
+ *  caller one at a time by GetStatus ().
+ */
+STATIC
+EFI_STATUS
+NetsecReapTx (
+  IN  NETSEC_DRIVER       *LanDriver
+  )
+{
+  ogma_err_t    ogma_err;
+
+  ogma_err = ogma_clear_desc_ring_irq_status (LanDriver->Handle,
+                                              OGMA_DESC_RING_ID_NRM_TX,
+                                              OGMA_CH_IRQ_REG_EMPTY);
+  if (ogma_err != OGMA_ERR_OK) {
+    DEBUG ((DEBUG_ERROR,
+      "NETSEC: ogma_clear_desc_ring_irq_status failed with error code: %d\n",
+      (INT32)ogma_err));
+    return EFI_DEVICE_ERROR;
+  }
+
+  ogma_err = ogma_clean_tx_desc_ring (LanDriver->Handle,
+                                      OGMA_DESC_RING_ID_NRM_TX);
+  if (ogma_err != OGMA_ERR_OK) {
+    DEBUG ((DEBUG_ERROR,
+      "NETSEC: ogma_clean_tx_desc_ring failed with error code: %d\n",
+      (INT32)ogma_err));
+    return EFI_DEVICE_ERROR;
+  }
+
+  return EFI_SUCCESS;
+}
+
 /*
  *  UEFI GetStatus () function
  */
@@ -571,8 +806,10 @@ SnpGetStatus (
 
   Snp->Mode->MediaPresent = phy_link_status.up_flag;
 
-  ogma_err = ogma_clean_tx_desc_ring (LanDriver->Handle,
-                                      OGMA_DESC_RING_ID_NRM_TX);
+  Status = NetsecReapTx (LanDriver);
+  if (EFI_ERROR (Status)) {
+    goto ExitUnlock;
+  }
 
   if (TxBuff != NULL) {
     *TxBuff = NULL;
@@ -587,7 +824,7 @@ SnpGetStatus (
       if (pkt_handle->Released) {
         *TxBuff = pkt_handle->Buffer;
         RemoveEntryList (Link);
-        FreePool (pkt_handle);
+        pfdep_put_tx_pkt_handle (&LanDriver->PacketPool, pkt_handle);
         break;
       }
     }
@@ -639,13 +876,7 @@ SnpTransmit (
     return EFI_DEVICE_ERROR;
   }
 
-  pkt_handle = AllocateZeroPool (sizeof (*pkt_handle));
-  if (pkt_handle == NULL) {
-    return EFI_OUT_OF_RESOURCES;
-  }
-
-  pkt_handle->Buffer = BufAddr;
-  pkt_handle->RecycleForTx = TRUE;
+  pkt_handle = NULL;
 
   // Serialize access to data and registers
   SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
@@ -669,25 +900,6 @@ SnpTransmit (
   // Find the LanDriver structure
   LanDriver = INSTANCE_FROM_SNP_THIS (Snp);
 
-  ogma_err = ogma_clear_desc_ring_irq_status (LanDriver->Handle,
-                                              OGMA_DESC_RING_ID_NRM_TX,
-                                              OGMA_CH_IRQ_REG_EMPTY);
-  if (ogma_err != OGMA_ERR_OK) {
-    DEBUG ((DEBUG_ERROR,
-      "NETSEC: ogma_clear_desc_ring_irq_status failed with error code: %d\n",
-      (INT32)ogma_err));
-    ReturnUnlock (EFI_DEVICE_ERROR);
-  }
-
-  ogma_err = ogma_clean_tx_desc_ring (LanDriver->Handle,
-                                      OGMA_DESC_RING_ID_NRM_TX);
-  if (ogma_err != OGMA_ERR_OK) {
-    DEBUG ((DEBUG_ERROR,
-      "NETSEC: ogma_clean_tx_desc_ring failed with error code: %d\n",
-      (INT32)ogma_err));
-    ReturnUnlock (EFI_DEVICE_ERROR);
-  }
-
   // Ensure header is correct size if non-zero
   if (HdrSize) {
     if (HdrSize != Snp->Mode->MediaHeaderSize) {
@@ -713,6 +925,39 @@ SnpTransmit (
       sizeof (UINT16));
   }
 
+  //
+  // Completed descriptors are only reaped in batches: here, when the ring
+  // has run out of room, and from GetStatus (). If the ring is still full
+  // after reaping, let the caller retry rather than spinning on the
+  // hardware.
+  //
+  tx_avail_num = ogma_get_tx_avail_num (LanDriver->Handle,
+                                        OGMA_DESC_RING_ID_NRM_TX);
+  if (tx_avail_num < SCAT_NUM) {
+    Status = NetsecReapTx (LanDriver);
+    if (EFI_ERROR (Status)) {
+      goto ExitUnlock;
+    }
+    tx_avail_num = ogma_get_tx_avail_num (LanDriver->Handle,
+                                          OGMA_DESC_RING_ID_NRM_TX);
+    if (tx_avail_num < SCAT_NUM) {
+      LanDriver->Counters.TxRingFull++;
+      ReturnUnlock (EFI_NOT_READY);
+    }
+  }
+
+  //
+  // Every in-flight packet holds a handle from the pool until the caller
+  // reclaims its buffer through GetStatus (), so running out of handles
+  // means the caller has not been recycling its buffers.
+  //
+  pkt_handle = pfdep_get_tx_pkt_handle (&LanDriver->PacketPool);
+  if (pkt_handle == NULL) {
+    ReturnUnlock (EFI_NOT_READY);
+  }
+
+  pkt_handle->Buffer = BufAddr;
+
   Status = DmaMap (MapOperationBusMasterRead, BufAddr, &BufSize,
              &scat_info.phys_addr, &pkt_handle->Mapping);
   if (EFI_ERROR (Status)) {
@@ -727,12 +972,6 @@ SnpTransmit (
   tx_pkt_ctrl.pass_through_flag     = OGMA_TRUE;
   tx_pkt_ctrl.target_desc_ring_id   = OGMA_DESC_RING_ID_GMAC;
 
-  // check empty slot
-  do {
-    tx_avail_num = ogma_get_tx_avail_num (LanDriver->Handle,
-                                          OGMA_DESC_RING_ID_NRM_TX);
-  } while (tx_avail_num < SCAT_NUM);
-
   // send
   ogma_err = ogma_set_tx_pkt_data (LanDriver->Handle,
                                    OGMA_DESC_RING_ID_NRM_TX,
@@ -743,7 +982,6 @@ SnpTransmit (
 
   if (ogma_err != OGMA_ERR_OK) {
     DmaUnmap (pkt_handle->Mapping);
-    FreePool (pkt_handle);
     DEBUG ((DEBUG_ERROR,
       "NETSEC: ogma_set_tx_pkt_data failed with error code: %d\n",
       (INT32)ogma_err));
@@ -755,17 +993,92 @@ SnpTransmit (
   // consumed by the hardware.
   //
   InsertTailList (&LanDriver->TxBufferList, &pkt_handle->Link);
+  LanDriver->Counters.TxPackets++;
 
   gBS->RestoreTPL (SavedTpl);
   return EFI_SUCCESS;
 
   // Restore TPL and return
 ExitUnlock:
-  FreePool (pkt_handle);
+  if (pkt_handle != NULL) {
+    pfdep_put_tx_pkt_handle (&LanDriver->PacketPool, pkt_handle);
+  }
   gBS->RestoreTPL (SavedTpl);
   return Status;
 }
 
+/*
+ *  Number of received packets ready to be pulled off the RX ring. The RX
+ *  packet counter is only read, and the top level IRQs only re-armed, once
+ *  the previous batch has been drained completely.
+ */
+STATIC
+UINTN
+NetsecRxPendingGet (
+  IN  NETSEC_DRIVER       *LanDriver
+  )
+{
+  if (LanDriver->RxPending == 0) {
+    LanDriver->RxPending = ogma_get_rx_num (LanDriver->Handle,
+                                            OGMA_DESC_RING_ID_NRM_RX);
+    if (LanDriver->RxPending > 0) {
+      LanDriver->Counters.RxBatches++;
+      ogma_enable_top_irq (LanDriver->Handle,
+                           OGMA_TOP_IRQ_REG_NRM_TX | OGMA_TOP_IRQ_REG_NRM_RX);
+    }
+  }
+  return LanDriver->RxPending;
+}
+
+/*
+ *  Pull the next received packet off the RX ring. The descriptor is
+ *  refilled with a buffer from the packet pool, and the returned buffer
+ *  must be handed back with pfdep_free_pkt_buf () once consumed.
+ */
+STATIC
+EFI_STATUS
+NetsecRxDescGet (
+  IN  NETSEC_DRIVER       *LanDriver,
+  OUT pfdep_pkt_handle_t  *PktHandle,
+  OUT ogma_frag_info_t    *RxData,
+  OUT UINT16              *Len
+  )
+{
+  ogma_err_t          ogma_err;
+  ogma_rx_pkt_info_t  rx_pkt_info;
+
+  if (NetsecRxPendingGet (LanDriver) == 0) {
+    return EFI_NOT_READY;
+  }
+
+  ogma_err = ogma_get_rx_pkt_data (LanDriver->Handle,
+                                   OGMA_DESC_RING_ID_NRM_RX,
+                                   &rx_pkt_info, RxData, Len, PktHandle);
+
+  //
+  // The descriptor is consumed even if no replacement buffer could be
+  // allocated; the packet is dropped and the ring re-armed in that case.
+  //
+  if (ogma_err == OGMA_ERR_OK || ogma_err == OGMA_ERR_ALLOC) {
+    LanDriver->RxPending--;
+  }
+
+  if (ogma_err == OGMA_ERR_OK) {
+    LanDriver->Counters.RxPackets++;
+  } else if (ogma_err == OGMA_ERR_ALLOC) {
+    LanDriver->Counters.RxDropped++;
+  }
+
+  if (ogma_err != OGMA_ERR_OK) {
+    DEBUG ((DEBUG_ERROR,
+      "NETSEC: ogma_get_rx_pkt_data failed with error code: %d\n",
+      (INT32)ogma_err));
+    return EFI_DEVICE_ERROR;
+  }
+
+  return EFI_SUCCESS;
+}
+
 /*
  *  UEFI Receive() function
  */
@@ -785,8 +1098,6 @@ SnpReceive (
   EFI_STATUS          Status;
   NETSEC_DRIVER       *LanDriver;
 
-  ogma_err_t          ogma_err;
-  ogma_rx_pkt_info_t  rx_pkt_info;
   ogma_frag_info_t    rx_data;
   ogma_uint16         len;
   pfdep_pkt_handle_t  pkt_handle;
@@ -818,43 +1129,205 @@ SnpReceive (
   // Find the LanDriver structure
   LanDriver = INSTANCE_FROM_SNP_THIS (Snp);
 
-  if (ogma_get_rx_num (LanDriver->Handle, OGMA_DESC_RING_ID_NRM_RX) > 0) {
+  Status = NetsecRxDescGet (LanDriver, &pkt_handle, &rx_data, &len);
+  if (EFI_ERROR (Status)) {
+    goto ExitUnlock;
+  }
 
-    ogma_err = ogma_get_rx_pkt_data (LanDriver->Handle,
-                                    OGMA_DESC_RING_ID_NRM_RX,
-                                    &rx_pkt_info, &rx_data, &len, &pkt_handle);
-    if (ogma_err != OGMA_ERR_OK) {
-      DEBUG ((DEBUG_ERROR,
-        "NETSEC: ogma_get_rx_pkt_data failed with error code: %d\n",
-        (INT32)ogma_err));
-      ReturnUnlock (EFI_DEVICE_ERROR);
+  CopyMem (Data, (VOID *)rx_data.addr, len);
+  *BuffSize = len;
+
+  pfdep_free_pkt_buf (&LanDriver->PacketPool, rx_data.len, rx_data.addr,
+    rx_data.phys_addr, PFDEP_TRUE, pkt_handle);
+
+  if (HdrSize != NULL) {
+    *HdrSize = LanDriver->SnpMode.MediaHeaderSize;
+  }
+
+  Status = EFI_SUCCESS;
+
+  // Restore TPL and return
+ExitUnlock:
+  gBS->RestoreTPL (SavedTpl);
+  return Status;
+}
+
+STATIC
+NETSEC_RX_LOAN *
+NetsecRxLoanGet (
+  IN  NETSEC_DRIVER       *LanDriver
+  )
+{
+  UINTN     Index;
+
+  for (Index = 0; Index < NETSEC_MAX_RX_LOANS; Index++) {
+    if (!LanDriver->RxLoans[Index].InUse) {
+      LanDriver->RxLoans[Index].InUse = TRUE;
+      return &LanDriver->RxLoans[Index];
     }
+  }
+  return NULL;
+}
 
-    DmaUnmap (pkt_handle->Mapping);
-    pkt_handle->Mapping = NULL;
+STATIC
+EFI_STATUS
+EFIAPI
+NetsecRxBufferRelease (
+  IN  NETSEC_RX_BUFFER    *RxBuffer
+  )
+{
+  NETSEC_RX_LOAN      *RxLoan;
+  EFI_TPL             SavedTpl;
+  EFI_STATUS          Status;
 
-    CopyMem (Data, (VOID *)rx_data.addr, len);
-    *BuffSize = len;
+  RxLoan = BASE_CR (RxBuffer, NETSEC_RX_LOAN, RxBuffer);
+  ASSERT (RxLoan->InUse);
 
-    pfdep_free_pkt_buf (LanDriver->Handle, rx_data.len, rx_data.addr,
-      rx_data.phys_addr, PFDEP_TRUE, pkt_handle);
-  } else {
-    // not received any packets
-    ReturnUnlock (EFI_NOT_READY);
+  SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  ASSERT (RxLoan->LanDriver->RxLoansOut > 0);
+  RxLoan->LanDriver->RxLoansOut--;
+
+  // Keep the buffer aside until the interface is brought up again
+  if (RxLoan->LanDriver->Snp.Mode->State != EfiSimpleNetworkInitialized) {
+    RxLoan->Parked = TRUE;
+    ReturnUnlock (EFI_NOT_STARTED);
   }
 
-  if (HdrSize != NULL) {
-    *HdrSize = LanDriver->SnpMode.MediaHeaderSize;
+  pfdep_free_pkt_buf (&RxLoan->LanDriver->PacketPool, 0, NULL, 0, PFDEP_TRUE,
+    RxLoan->PktHandle);
+  RxLoan->InUse = FALSE;
+  Status = EFI_SUCCESS;
+
+ExitUnlock:
+  gBS->RestoreTPL (SavedTpl);
+  return Status;
+}
+
+/*
+ *  NETSEC_NET_PROTOCOL ReceiveBurst() function
+ */
+STATIC
+EFI_STATUS
+EFIAPI
+NetsecNetReceiveBurst (
+  IN      NETSEC_NET_PROTOCOL   *This,
+      OUT NETSEC_RX_BUFFER      **RxBuffers,
+  IN  OUT UINTN                 *Count
+  )
+{
+  NETSEC_DRIVER       *LanDriver;
+  NETSEC_RX_LOAN      *RxLoan;
+  EFI_TPL             SavedTpl;
+  EFI_STATUS          Status;
+  UINTN               Received;
+
+  ogma_frag_info_t    rx_data;
+  ogma_uint16         len;
+  pfdep_pkt_handle_t  pkt_handle;
+
+  if ((This == NULL) || (RxBuffers == NULL) || (Count == NULL) ||
+      (*Count == 0)) {
+    return EFI_INVALID_PARAMETER;
   }
 
-  ogma_clear_desc_ring_irq_status (LanDriver->Handle,
-                                   OGMA_DESC_RING_ID_NRM_TX,
-                                   OGMA_CH_IRQ_REG_EMPTY);
+  LanDriver = INSTANCE_FROM_NETSEC_NET (This);
+
+  // Serialize access to data and registers
+  SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
 
-  ogma_clean_tx_desc_ring (LanDriver->Handle, OGMA_DESC_RING_ID_NRM_TX);
+  if (LanDriver->Snp.Mode->State != EfiSimpleNetworkInitialized) {
+    *Count = 0;
+    ReturnUnlock (EFI_NOT_STARTED);
+  }
 
-  ogma_enable_top_irq (LanDriver->Handle,
-                       OGMA_TOP_IRQ_REG_NRM_TX | OGMA_TOP_IRQ_REG_NRM_RX);
+  //
+  // Drain as many pending descriptors as the caller asked for. Each of them
+  // is refilled from the packet pool straight away, and the received buffer
+  // is lent to the caller until it is released.
+  //
+  Status = EFI_NOT_READY;
+  for (Received = 0; Received < *Count; Received++) {
+    if (NetsecRxPendingGet (LanDriver) == 0) {
+      break;
+    }
+
+    RxLoan = NetsecRxLoanGet (LanDriver);
+    if (RxLoan == NULL) {
+      Status = EFI_OUT_OF_RESOURCES;
+      break;
+    }
+
+    Status = NetsecRxDescGet (LanDriver, &pkt_handle, &rx_data, &len);
+    if (EFI_ERROR (Status)) {
+      RxLoan->InUse = FALSE;
+      break;
+    }
+
+    RxLoan->LanDriver = LanDriver;
+    RxLoan->PktHandle = pkt_handle;
+    RxLoan->RxBuffer.Packet = rx_data.addr;
+    RxLoan->RxBuffer.PacketSize = len;
+    RxLoan->RxBuffer.Release = NetsecRxBufferRelease;
+
+    RxBuffers[Received] = &RxLoan->RxBuffer;
+    LanDriver->RxLoansOut++;
+  }
+
+  *Count = Received;
+  if (Received > 0) {
+    Status = EFI_SUCCESS;
+  }
+
+  // Restore TPL and return
+ExitUnlock:
+  gBS->RestoreTPL (SavedTpl);
+  return Status;
+}
+
+/*
+ *  NETSEC_NET_PROTOCOL SetRxCoalescing() function
+ */
+STATIC
+EFI_STATUS
+EFIAPI
+NetsecNetSetRxCoalescing (
+  IN  NETSEC_NET_PROTOCOL   *This,
+  IN  UINTN                 Packets,
+  IN  UINTN                 Usec
+  )
+{
+  NETSEC_DRIVER       *LanDriver;
+  EFI_TPL             SavedTpl;
+  EFI_STATUS          Status;
+  ogma_err_t          ogma_err;
+
+  if ((This == NULL) || (Packets == 0) || (Packets > OGMA_INT_PKTCNT_MAX) ||
+      (Usec > MAX_UINT16)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  LanDriver = INSTANCE_FROM_NETSEC_NET (This);
+
+  // Serialize access to data and registers
+  SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  LanDriver->RxIntPktCnt = (UINT16)Packets;
+  LanDriver->RxIntTmrCntUs = (UINT16)Usec;
+
+  // Otherwise, the new values are programmed by SnpInitialize ()
+  if (LanDriver->Snp.Mode->State == EfiSimpleNetworkInitialized) {
+    ogma_err = ogma_set_irq_coalesce_param (LanDriver->Handle,
+                                            OGMA_DESC_RING_ID_NRM_RX,
+                                            LanDriver->RxIntPktCnt, OGMA_FALSE,
+                                            LanDriver->RxIntTmrCntUs);
+    if (ogma_err != OGMA_ERR_OK) {
+      DEBUG ((DEBUG_ERROR,
+        "NETSEC: ogma_set_irq_coalesce_param() failed with error code %d\n",
+        (INT32)ogma_err));
+      ReturnUnlock (EFI_DEVICE_ERROR);
+    }
+  }
 
   Status = EFI_SUCCESS;
 
@@ -864,6 +1337,86 @@ ExitUnlock:
   return Status;
 }
 
+/*
+ *  NETSEC_NET_PROTOCOL GetRxCoalescing() function
+ */
+STATIC
+EFI_STATUS
+EFIAPI
+NetsecNetGetRxCoalescing (
+  IN  NETSEC_NET_PROTOCOL   *This,
+  OUT UINTN                 *Packets,
+  OUT UINTN                 *Usec
+  )
+{
+  NETSEC_DRIVER       *LanDriver;
+
+  if ((This == NULL) || (Packets == NULL) || (Usec == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  LanDriver = INSTANCE_FROM_NETSEC_NET (This);
+
+  *Packets = LanDriver->RxIntPktCnt;
+  *Usec = LanDriver->RxIntTmrCntUs;
+
+  return EFI_SUCCESS;
+}
+
+/*
+ *  NETSEC_NET_PROTOCOL GetCounters() function
+ */
+STATIC
+EFI_STATUS
+EFIAPI
+NetsecNetGetCounters (
+  IN  NETSEC_NET_PROTOCOL   *This,
+  OUT NETSEC_NET_COUNTERS   *Counters
+  )
+{
+  NETSEC_DRIVER       *LanDriver;
+  EFI_TPL             SavedTpl;
+
+  if ((This == NULL) || (Counters == NULL)) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  LanDriver = INSTANCE_FROM_NETSEC_NET (This);
+
+  SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
+  CopyMem (Counters, &LanDriver->Counters, sizeof (*Counters));
+  gBS->RestoreTPL (SavedTpl);
+
+  return EFI_SUCCESS;
+}
+
+/*
+ *  WaitForPacket notification function. It runs whenever the event is
+ *  waited on or checked, and signals the event when received packets are
+ *  ready on the RX ring. Running at TPL_CALLBACK keeps it serialized with
+ *  the SNP functions.
+ */
+STATIC
+VOID
+EFIAPI
+NetsecWaitForPacketNotify (
+  IN  EFI_EVENT   Event,
+  IN  VOID        *Context
+  )
+{
+  NETSEC_DRIVER       *LanDriver;
+
+  LanDriver = Context;
+
+  if (LanDriver->Snp.Mode->State != EfiSimpleNetworkInitialized) {
+    return;
+  }
+
+  if (NetsecRxPendingGet (LanDriver) > 0) {
+    gBS->SignalEvent (Event);
+  }
+}
+
 EFI_STATUS
 NetsecInit (
   IN      EFI_HANDLE        DriverBindingHandle,
@@ -907,9 +1460,18 @@ NetsecInit (
     goto CloseDeviceProtocol;
   }
 
+  Status = gBS->CreateEvent (EVT_NOTIFY_WAIT, TPL_CALLBACK,
+                  NetsecWaitForPacketNotify, LanDriver, &Snp->WaitForPacket);
+  if (EFI_ERROR (Status)) {
+    DEBUG ((DEBUG_ERROR, "%a: CreateEvent failed - %r\n",
+      __FUNCTION__, Status));
+    ogma_terminate (LanDriver->Handle);
+    pfdep_pkt_pool_release (&LanDriver->PacketPool);
+    goto CloseDeviceProtocol;
+  }
+
   // Assign fields and func pointers
   Snp->Revision = EFI_SIMPLE_NETWORK_PROTOCOL_REVISION;
-  Snp->WaitForPacket = NULL;
   Snp->Initialize = SnpInitialize;
   Snp->Start = SnpStart;
   Snp->Stop = SnpStop;
@@ -917,13 +1479,23 @@ NetsecInit (
   Snp->Shutdown = SnpShutdown;
   Snp->ReceiveFilters = SnpReceiveFilters;
   Snp->StationAddress = NULL;
-  Snp->Statistics = NULL;
+  Snp->Statistics = SnpStatistics;
   Snp->MCastIpToMac = NULL;
   Snp->NvData = NULL;
   Snp->GetStatus = SnpGetStatus;
   Snp->Transmit = SnpTransmit;
   Snp->Receive = SnpReceive;
 
+  LanDriver->NetsecNet.ReceiveBurst = NetsecNetReceiveBurst;
+  LanDriver->NetsecNet.SetRxCoalescing = NetsecNetSetRxCoalescing;
+  LanDriver->NetsecNet.GetRxCoalescing = NetsecNetGetRxCoalescing;
+  LanDriver->NetsecNet.GetCounters = NetsecNetGetCounters;
+
+  LanDriver->RxIntPktCnt = FixedPcdGet16 (PcdRxIntPktCnt);
+  LanDriver->RxIntTmrCntUs = FixedPcdGet16 (PcdRxIntTmrCntUs);
+  LanDriver->Counters.RxRingEntries = FixedPcdGet16 (PcdDecRxDescNum);
+  LanDriver->Counters.TxRingEntries = FixedPcdGet16 (PcdEncTxDescNum);
+
   // Fill in simple network mode structure
   SnpMode->State = EfiSimpleNetworkStopped;
   SnpMode->HwAddressSize = NET_ETHER_ADDR_LEN;
@@ -955,8 +1527,8 @@ NetsecInit (
   // Mac address is changeable
   SnpMode->MacAddressChangeable = TRUE;
 
-  // We can only transmit one packet at a time
-  SnpMode->MultipleTxSupported = FALSE;
+  // Up to PcdEncTxDescNum packets may be queued in the TX ring at a time
+  SnpMode->MultipleTxSupported = TRUE;
 
   // MediaPresent checks for cable connection and partner link
   SnpMode->MediaPresentSupported = TRUE;
@@ -982,6 +1554,7 @@ NetsecInit (
                   &ControllerHandle,
                   &gEfiSimpleNetworkProtocolGuid, Snp,
                   &gEfiDevicePathProtocolGuid, &LanDriver->DevicePath,
+                  &gNetsecNetProtocolGuid, &LanDriver->NetsecNet,
                   NULL);
 
   LanDriver->ControllerHandle = ControllerHandle;
@@ -990,7 +1563,9 @@ NetsecInit (
   if (EFI_ERROR (Status)) {
     DEBUG ((DEBUG_ERROR, "%a: InstallMultipleProtocolInterfaces failed - %r\n",
       __FUNCTION__, Status));
+    gBS->CloseEvent (Snp->WaitForPacket);
     ogma_terminate (LanDriver->Handle);
+    pfdep_pkt_pool_release (&LanDriver->PacketPool);
     goto CloseDeviceProtocol;
   }
   return EFI_SUCCESS;
@@ -1013,6 +1588,7 @@ NetsecRelease (
 {
   EFI_SIMPLE_NETWORK_PROTOCOL   *Snp;
   NETSEC_DRIVER                 *LanDriver;
+  EFI_TPL                       SavedTpl;
   EFI_STATUS                    Status;
 
   Status = gBS->HandleProtocol (ControllerHandle,
@@ -1025,10 +1601,22 @@ NetsecRelease (
 
   LanDriver = INSTANCE_FROM_SNP_THIS (Snp);
 
+  SavedTpl = gBS->RaiseTPL (TPL_CALLBACK);
+
+  // Lent buffers live in the packet pool, which is released below
+  if (LanDriver->RxLoansOut != 0) {
+    DEBUG ((DEBUG_WARN, "NETSEC: %Lu RX buffers still lent, refusing to stop\n",
+      (UINT64)LanDriver->RxLoansOut));
+    gBS->RestoreTPL (SavedTpl);
+    return EFI_ACCESS_DENIED;
+  }
+
   Status = gBS->UninstallMultipleProtocolInterfaces (ControllerHandle,
                   &gEfiSimpleNetworkProtocolGuid, Snp,
                   &gEfiDevicePathProtocolGuid, &LanDriver->DevicePath,
+                  &gNetsecNetProtocolGuid, &LanDriver->NetsecNet,
                   NULL);
+  gBS->RestoreTPL (SavedTpl);
   if (EFI_ERROR (Status)) {
     return Status;
   }
@@ -1037,9 +1625,14 @@ NetsecRelease (
     SnpShutdown (Snp);
   }
 
+  // Buffers released while the interface was down go back to the pool
+  NetsecRxLoansReclaim (LanDriver);
+
   ogma_terminate (LanDriver->Handle);
+  pfdep_pkt_pool_release (&LanDriver->PacketPool);
 
   gBS->CloseEvent (LanDriver->ExitBootEvent);
+  gBS->CloseEvent (Snp->WaitForPacket);
 
   Status = gBS->CloseProtocol (ControllerHandle,
                                &gEdkiiNonDiscoverableDeviceProtocolGuid,
@@ -26,6 +26,7 @@
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiLib.h>
 
+#include <Protocol/NetsecNet.h>
 #include <Protocol/NonDiscoverableDevice.h>
 
 #include "netsec_for_uefi/netsec_sdk/include/ogma_api.h"
@@ -51,13 +52,34 @@ typedef struct {
 } NETSEC_DEVICE_PATH;
 #pragma pack()
 
+//
+// Maximum number of RX buffers lent to zero-copy receive consumers. The
+// packet pool holds this many buffers on top of those needed by the RX ring,
+// so reception does not stall while consumers hold on to frames.
+//
+#define NETSEC_MAX_RX_LOANS         (FixedPcdGet16 (PcdDecRxDescNum) / 2)
+
+typedef struct _NETSEC_DRIVER NETSEC_DRIVER;
+
 typedef struct {
+  NETSEC_RX_BUFFER                  RxBuffer;
+  NETSEC_DRIVER                     *LanDriver;
+  pfdep_pkt_handle_t                PktHandle;
+  BOOLEAN                           InUse;
+  // Released while the interface was down, freed on the next Initialize ()
+  BOOLEAN                           Parked;
+} NETSEC_RX_LOAN;
+
+struct _NETSEC_DRIVER {
   // Driver signature
   UINT32                            Signature;
   EFI_HANDLE                        ControllerHandle;
 
   // EFI SNP protocol instances
   EFI_SIMPLE_NETWORK_PROTOCOL       Snp;
+
+  // Driver private zero-copy receive protocol
+  NETSEC_NET_PROTOCOL               NetsecNet;
   EFI_SIMPLE_NETWORK_MODE           SnpMode;
 
   // EFI Snp statistics instance
@@ -69,6 +91,30 @@ typedef struct {
   // List of submitted TX buffers
   LIST_ENTRY                        TxBufferList;
 
+  // Preallocated RX buffers and TX/RX packet handles
+  PACKET_POOL                       PacketPool;
+
+  // Received packets reported by ogma_get_rx_num () not yet pulled off
+  // the RX ring
+  UINTN                             RxPending;
+
+  NETSEC_RX_LOAN                    RxLoans[NETSEC_MAX_RX_LOANS];
+  // Buffers lent to consumers and not released yet
+  UINTN                             RxLoansOut;
+
+  // RX interrupt coalescing parameters
+  UINT16                            RxIntPktCnt;
+  UINT16                            RxIntTmrCntUs;
+
+  // Data path counters
+  NETSEC_NET_COUNTERS               Counters;
+
+  // GMAC MMC counters accumulated since the last statistics reset
+  UINT64                            MmcCounters[MMC_COUNTER_NUM];
+  // Raw GMAC MMC counter values at the last read
+  UINT32                            MmcLastRead[MMC_COUNTER_NUM];
+  UINT64                            RxDroppedAtReset;
+
   EFI_EVENT                         ExitBootEvent;
 
   NON_DISCOVERABLE_DEVICE           *Dev;
@@ -76,10 +122,11 @@ typedef struct {
   NETSEC_DEVICE_PATH                DevicePath;
 
   UINTN                             PhyAddress;
-} NETSEC_DRIVER;
+};
 
 #define NETSEC_SIGNATURE            SIGNATURE_32('n', 't', 's', 'c')
 #define INSTANCE_FROM_SNP_THIS(a)   CR((a), NETSEC_DRIVER, Snp, NETSEC_SIGNATURE)
+#define INSTANCE_FROM_NETSEC_NET(a) CR((a), NETSEC_DRIVER, NetsecNet, NETSEC_SIGNATURE)
 
 /*------------------------------------------------------------------------------
 
@@ -112,7 +159,39 @@ NetsecRelease (
 
 #define SCAT_NUM                    1
 
-#define RXINT_TMR_CNT_US            0
-#define RXINT_PKTCNT                1
+// Indices into the GMAC MMC register array filled by ogma_read_gmac_stat ()
+#define MMC_INTR_RX                 0
+#define MMC_INTR_TX                 1
+#define MMC_INTR_MASK_RX            2
+#define MMC_INTR_MASK_TX            3
+#define MMC_TXOCTETCOUNT_GB         4
+#define MMC_TXFRAMECOUNT_GB         5
+#define MMC_TXBROADCASTFRAMES_G     6
+#define MMC_TXMULTICASTFRAMES_G     7
+#define MMC_TXUNICASTFRAMES_GB      14
+#define MMC_TXSINGLECOL_G           18
+#define MMC_TXMULTICOL_G            19
+#define MMC_TXLATECOL               21
+#define MMC_TXEXESSCOL              22
+#define MMC_TXFRAMECOUNT_G          25
+#define MMC_RXFRAMECOUNT_GB         29
+#define MMC_RXOCTETCOUNT_GB         30
+#define MMC_RXBROADCASTFRAMES_G     32
+#define MMC_RXMULTICASTFRAMES_G     33
+#define MMC_RXCRCERROR              34
+#define MMC_RXRUNTERROR             36
+#define MMC_RXJABBERERROR           37
+#define MMC_RXUNDERSIZE_G           38
+#define MMC_RXOVERSIZE_G            39
+#define MMC_RXUNICASTFRAMES_G       46
+#define MMC_RXFIFOOVERFLOW          50
+#define MMC_IPC_INTR_MASK_RX        53
+#define MMC_IPC_INTR_RX             54
+#define MMC_COUNTER_NUM             83
+
+// The interrupt status and mask registers are not counters
+#define MMC_IS_COUNTER(Index)       ((Index) > MMC_INTR_MASK_TX &&      \
+                                     (Index) != MMC_IPC_INTR_MASK_RX && \
+                                     (Index) != MMC_IPC_INTR_RX)
 
 #endif
@@ -55,6 +55,12 @@
 #define OGMA_TCP_SEG_LEN_MAX 1460
 #define OGMA_TCP_JUMBO_SEG_LEN_MAX 8960
 
+/**
+ * Size of the RX packet buffers requested from pfdep_alloc_pkt_buf()
+ */
+#define OGMA_RX_PKT_BUF_LEN 1522
+#define OGMA_RX_JUMBO_PKT_BUF_LEN 9022
+
 /**
  * Number of ER check result for received packet
  */
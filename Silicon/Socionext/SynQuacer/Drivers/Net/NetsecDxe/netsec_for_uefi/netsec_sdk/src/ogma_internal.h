@@ -24,8 +24,6 @@
 
 #define OGMA_INSTANCE_NUM_MAX 1
 
-#define OGMA_RX_PKT_BUF_LEN 1522
-#define OGMA_RX_JUMBO_PKT_BUF_LEN 9022
 #define OGMA_DUMMY_DESC_ENTRY_LEN 48
 
 #define OGMA_REG_ADDR_CLK_EN OGMA_REG_ADDR_CLK_EN_0
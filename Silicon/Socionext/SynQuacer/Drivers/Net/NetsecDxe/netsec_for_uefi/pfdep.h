@@ -64,10 +64,29 @@ typedef struct {
     LIST_ENTRY  Link;
     VOID        *Buffer;
     VOID        *Mapping;
+    EFI_PHYSICAL_ADDRESS PhysAddr;
     BOOLEAN     RecycleForTx;
     BOOLEAN     Released;
 } PACKET_HANDLE;
 
+//
+// Preallocated packet buffers and handles. The RX buffers live in a single
+// DMA region that is mapped once for the lifetime of the pool, and both RX
+// and TX handles are recycled through free lists rather than the pool
+// allocator.
+//
+typedef struct {
+    LIST_ENTRY              RxFreeList;
+    LIST_ENTRY              TxFreeList;
+    PACKET_HANDLE           *Handles;
+    UINTN                   HandleCount;
+    VOID                    *Buffers;
+    UINTN                   BufferSize;
+    UINTN                   BufferPages;
+    VOID                    *Mapping;
+    EFI_PHYSICAL_ADDRESS    PhysBase;
+} PACKET_POOL;
+
 typedef VOID *pfdep_dev_handle_t;
 typedef PACKET_HANDLE *pfdep_pkt_handle_t;
 typedef EFI_PHYSICAL_ADDRESS pfdep_phys_addr_t;
@@ -149,6 +168,26 @@ void pfdep_free_pkt_buf (
     pfdep_pkt_handle_t pkt_handle
     );
 
+pfdep_err_t pfdep_pkt_pool_init (
+    PACKET_POOL *pool_p,
+    pfdep_uint32 rx_buf_num,
+    pfdep_uint16 rx_buf_len,
+    pfdep_uint32 tx_handle_num
+    );
+
+void pfdep_pkt_pool_release (
+    PACKET_POOL *pool_p
+    );
+
+pfdep_pkt_handle_t pfdep_get_tx_pkt_handle (
+    PACKET_POOL *pool_p
+    );
+
+void pfdep_put_tx_pkt_handle (
+    PACKET_POOL *pool_p,
+    pfdep_pkt_handle_t pkt_handle
+    );
+
 static __inline pfdep_err_t pfdep_init_hard_lock(pfdep_hard_lock_t *hard_lock_p)
 {
     (void)hard_lock_p; /* suppress compiler warning */
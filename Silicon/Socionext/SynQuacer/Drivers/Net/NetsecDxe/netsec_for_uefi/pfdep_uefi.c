@@ -101,15 +101,122 @@ pfdep_dma_free (
     addr);
 }
 
-//
-// On the receive path, we allocate a new packet and link it into the RX ring
-// before returning the received packet to the caller. This means we perform
-// one allocation and one free operation for each buffer received.
-// So let's cache a single packet, and get rid of most of the alloc/free
-// overhead on the RX path.
-//
-STATIC pfdep_pkt_handle_t mSparePacketBuffer;
-STATIC UINT32 mSparePacketBufferSize;
+pfdep_err_t
+pfdep_pkt_pool_init (
+  OUT PACKET_POOL               *pool_p,
+  IN  pfdep_uint32              rx_buf_num,
+  IN  pfdep_uint16              rx_buf_len,
+  IN  pfdep_uint32              tx_handle_num
+  )
+{
+  EFI_STATUS            Status;
+  PACKET_HANDLE         *Handle;
+  UINTN                 NumBytes;
+  UINTN                 Index;
+
+  SetMem (pool_p, sizeof (*pool_p), 0);
+  InitializeListHead (&pool_p->RxFreeList);
+  InitializeListHead (&pool_p->TxFreeList);
+
+  pool_p->HandleCount = rx_buf_num + tx_handle_num;
+  pool_p->Handles = AllocateZeroPool (pool_p->HandleCount * sizeof (PACKET_HANDLE));
+  if (pool_p->Handles == NULL) {
+    return PFDEP_ERR_ALLOC;
+  }
+
+  //
+  // Carve all RX buffers out of a single DMA region that is mapped as a
+  // common buffer once, so that handing a buffer to the RX ring does not
+  // involve any allocation or mapping at all.
+  //
+  pool_p->BufferSize = ALIGN_VALUE (rx_buf_len, mCpu->DmaBufferAlignment);
+  pool_p->BufferPages = EFI_SIZE_TO_PAGES (pool_p->BufferSize * rx_buf_num);
+  Status = DmaAllocateBuffer (EfiBootServicesData, pool_p->BufferPages,
+             &pool_p->Buffers);
+  if (EFI_ERROR (Status)) {
+    goto FreeHandles;
+  }
+
+  NumBytes = EFI_PAGES_TO_SIZE (pool_p->BufferPages);
+  Status = DmaMap (MapOperationBusMasterCommonBuffer, pool_p->Buffers,
+             &NumBytes, &pool_p->PhysBase, &pool_p->Mapping);
+  if (EFI_ERROR (Status) || NumBytes < pool_p->BufferSize * rx_buf_num) {
+    if (!EFI_ERROR (Status)) {
+      DmaUnmap (pool_p->Mapping);
+    }
+    goto FreeBuffers;
+  }
+
+  for (Index = 0; Index < pool_p->HandleCount; Index++) {
+    Handle = &pool_p->Handles[Index];
+    if (Index < rx_buf_num) {
+      Handle->Buffer = (UINT8 *)pool_p->Buffers + Index * pool_p->BufferSize;
+      Handle->PhysAddr = pool_p->PhysBase + Index * pool_p->BufferSize;
+      InsertTailList (&pool_p->RxFreeList, &Handle->Link);
+    } else {
+      Handle->RecycleForTx = TRUE;
+      InsertTailList (&pool_p->TxFreeList, &Handle->Link);
+    }
+  }
+
+  return PFDEP_ERR_OK;
+
+FreeBuffers:
+  DmaFreeBuffer (pool_p->BufferPages, pool_p->Buffers);
+  pool_p->Buffers = NULL;
+
+FreeHandles:
+  FreePool (pool_p->Handles);
+  pool_p->Handles = NULL;
+
+  return PFDEP_ERR_ALLOC;
+}
+
+VOID
+pfdep_pkt_pool_release (
+  IN  PACKET_POOL               *pool_p
+  )
+{
+  if (pool_p->Handles == NULL) {
+    return;
+  }
+
+  DmaUnmap (pool_p->Mapping);
+  DmaFreeBuffer (pool_p->BufferPages, pool_p->Buffers);
+  FreePool (pool_p->Handles);
+
+  SetMem (pool_p, sizeof (*pool_p), 0);
+}
+
+pfdep_pkt_handle_t
+pfdep_get_tx_pkt_handle (
+  IN  PACKET_POOL               *pool_p
+  )
+{
+  PACKET_HANDLE         *Handle;
+
+  if (IsListEmpty (&pool_p->TxFreeList)) {
+    return NULL;
+  }
+
+  Handle = BASE_CR (GetFirstNode (&pool_p->TxFreeList), PACKET_HANDLE, Link);
+  RemoveEntryList (&Handle->Link);
+
+  Handle->Buffer = NULL;
+  Handle->Mapping = NULL;
+  Handle->Released = FALSE;
+
+  return Handle;
+}
+
+VOID
+pfdep_put_tx_pkt_handle (
+  IN  PACKET_POOL               *pool_p,
+  IN  pfdep_pkt_handle_t        pkt_handle
+  )
+{
+  InsertTailList (&pool_p->TxFreeList, &pkt_handle->Link);
+}
 
 pfdep_err_t
 pfdep_alloc_pkt_buf (
@@ -120,31 +227,22 @@ pfdep_alloc_pkt_buf (
   OUT pfdep_pkt_handle_t        *pkt_handle_p
   )
 {
-  EFI_STATUS    Status;
-  UINTN         NumBytes;
-
-  NumBytes = ALIGN_VALUE (len, mCpu->DmaBufferAlignment);
-
-  if (InterlockedCompareExchange32 (&mSparePacketBufferSize, len, 0) == len) {
-    *pkt_handle_p = mSparePacketBuffer;
-  } else {
-    *pkt_handle_p = AllocateZeroPool (NumBytes + sizeof(PACKET_HANDLE) +
-                                      (mCpu->DmaBufferAlignment - 8));
-    if (*pkt_handle_p == NULL) {
-      return PFDEP_ERR_ALLOC;
-    }
+  PACKET_POOL           *Pool;
+  PACKET_HANDLE         *Handle;
 
-    (*pkt_handle_p)->Buffer = ALIGN_POINTER (*pkt_handle_p,
-                                             mCpu->DmaBufferAlignment);
-  }
+  Pool = (PACKET_POOL *)dev_handle;
 
-  *addr_p = (*pkt_handle_p)->Buffer;
-  Status = DmaMap (MapOperationBusMasterWrite, *addr_p, &NumBytes, phys_addr_p,
-             &(*pkt_handle_p)->Mapping);
-  if (EFI_ERROR (Status) || NumBytes < len) {
-    FreePool (*pkt_handle_p);
+  if (len > Pool->BufferSize || IsListEmpty (&Pool->RxFreeList)) {
     return PFDEP_ERR_ALLOC;
   }
+
+  Handle = BASE_CR (GetFirstNode (&Pool->RxFreeList), PACKET_HANDLE, Link);
+  RemoveEntryList (&Handle->Link);
+
+  *addr_p = Handle->Buffer;
+  *phys_addr_p = Handle->PhysAddr;
+  *pkt_handle_p = Handle;
+
   return PFDEP_ERR_OK;
 }
 
@@ -158,19 +256,25 @@ pfdep_free_pkt_buf (
   IN  pfdep_pkt_handle_t        pkt_handle
   )
 {
+  PACKET_POOL           *Pool;
+
   if (last_flag != PFDEP_TRUE) {
     return;
   }
 
-  if (pkt_handle->Mapping != NULL) {
-    DmaUnmap (pkt_handle->Mapping);
-  }
-
   if (pkt_handle->RecycleForTx) {
-      pkt_handle->Released = TRUE;
-  } else if (!InterlockedCompareExchange32 (&mSparePacketBufferSize, 0, len)) {
-    mSparePacketBuffer = pkt_handle;
+    //
+    // TX buffers are owned by the caller and mapped per packet; the handle
+    // is returned to the pool by SnpGetStatus () once the caller has been
+    // given its buffer back.
+    //
+    if (pkt_handle->Mapping != NULL) {
+      DmaUnmap (pkt_handle->Mapping);
+      pkt_handle->Mapping = NULL;
+    }
+    pkt_handle->Released = TRUE;
   } else {
-    FreePool (pkt_handle);
+    Pool = (PACKET_POOL *)dev_handle;
+    InsertTailList (&Pool->RxFreeList, &pkt_handle->Link);
   }
 }